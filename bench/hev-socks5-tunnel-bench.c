@@ -0,0 +1,661 @@
+/*
+ ============================================================================
+ Name        : hev-socks5-tunnel-bench.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Socks5 Tunnel Bench
+ ============================================================================
+ */
+
+/*
+ * The harness feeds synthetic IPv4 traffic into the tunnel through a
+ * datagram socketpair that stands in for the TUN fd, and terminates the
+ * relay side with an in-process loopback SOCKS5 server that sinks TCP
+ * streams and echoes UDP datagrams. Three workloads are measured:
+ *
+ *   tcp-bulk  : one connection, MSS-sized segments, Gbps and pps
+ *   tcp-churn : handshake + reset cycles, connections per second
+ *   udp-flood : timestamped echo datagrams, pps and p99 round-trip
+ *
+ * Allocations per packet are derived from the pbuf pool miss counter.
+ */
+
+#include <poll.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "hev-config.h"
+#include "hev-checksum.h"
+#include "hev-pbuf-pool.h"
+#include "hev-socks5-tunnel.h"
+
+#define BENCH_MTU (8500)
+#define BENCH_MSS (1400)
+#define BENCH_WINDOW (262144)
+#define BENCH_DURATION (5)
+#define BENCH_UDP_INFLIGHT (64)
+#define BENCH_UDP_SAMPLES (1000000)
+
+#define BENCH_SADDR (0x0a630002) /* 10.99.0.2 */
+#define BENCH_DADDR (0x0a630101) /* 10.99.1.1 */
+
+static int tun_fd = -1;
+static int socks_port;
+
+static uint64_t
+now_us (void)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static unsigned int
+checksum_step (unsigned int sum, const void *data, size_t len)
+{
+    const uint16_t *p = data;
+
+    for (; len > 1; len -= 2)
+        sum += *p++;
+    if (len)
+        sum += *(const uint8_t *)p;
+
+    return sum;
+}
+
+static uint16_t
+checksum_fold (unsigned int sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return ~sum;
+}
+
+static unsigned int
+checksum_pseudo (uint32_t saddr, uint32_t daddr, uint8_t proto, uint16_t len)
+{
+    unsigned int sum = 0;
+
+    sum += (saddr >> 16) + (saddr & 0xffff);
+    sum += (daddr >> 16) + (daddr & 0xffff);
+    sum += proto;
+    sum += len;
+
+    return sum;
+}
+
+struct ip4_hdr
+{
+    uint8_t vhl;
+    uint8_t tos;
+    uint16_t len;
+    uint16_t id;
+    uint16_t off;
+    uint8_t ttl;
+    uint8_t proto;
+    uint16_t sum;
+    uint32_t saddr;
+    uint32_t daddr;
+} __attribute__ ((packed));
+
+struct tcp_hdr
+{
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t seq;
+    uint32_t ack;
+    uint8_t off;
+    uint8_t flags;
+    uint16_t wnd;
+    uint16_t sum;
+    uint16_t urg;
+} __attribute__ ((packed));
+
+struct udp_hdr
+{
+    uint16_t sport;
+    uint16_t dport;
+    uint16_t len;
+    uint16_t sum;
+} __attribute__ ((packed));
+
+#define TCP_FLAG_FIN (0x01)
+#define TCP_FLAG_SYN (0x02)
+#define TCP_FLAG_RST (0x04)
+#define TCP_FLAG_ACK (0x10)
+
+static void
+ip4_hdr_init (struct ip4_hdr *ip, uint8_t proto, uint16_t len)
+{
+    memset (ip, 0, sizeof (*ip));
+    ip->vhl = 0x45;
+    ip->len = htons (len);
+    ip->ttl = 64;
+    ip->proto = proto;
+    ip->saddr = htonl (BENCH_SADDR);
+    ip->daddr = htonl (BENCH_DADDR);
+    ip->sum = checksum_fold (checksum_step (0, ip, sizeof (*ip)));
+}
+
+static int
+tcp_packet_send (uint16_t sport, uint32_t seq, uint32_t ack, uint8_t flags,
+                 const void *data, size_t len)
+{
+    uint8_t pkt[BENCH_MTU];
+    struct ip4_hdr *ip = (struct ip4_hdr *)pkt;
+    struct tcp_hdr *tcp = (struct tcp_hdr *)(pkt + sizeof (*ip));
+    unsigned int sum;
+
+    ip4_hdr_init (ip, IPPROTO_TCP, sizeof (*ip) + sizeof (*tcp) + len);
+
+    memset (tcp, 0, sizeof (*tcp));
+    tcp->sport = htons (sport);
+    tcp->dport = htons (80);
+    tcp->seq = htonl (seq);
+    tcp->ack = htonl (ack);
+    tcp->off = (sizeof (*tcp) / 4) << 4;
+    tcp->flags = flags;
+    tcp->wnd = htons (65535);
+    if (len)
+        memcpy (pkt + sizeof (*ip) + sizeof (*tcp), data, len);
+
+    sum = checksum_pseudo (BENCH_SADDR, BENCH_DADDR, IPPROTO_TCP,
+                           sizeof (*tcp) + len);
+    sum = checksum_step (sum, tcp, sizeof (*tcp) + len);
+    tcp->sum = checksum_fold (sum);
+
+    return write (tun_fd, pkt, sizeof (*ip) + sizeof (*tcp) + len);
+}
+
+static int
+udp_packet_send (uint16_t sport, const void *data, size_t len)
+{
+    uint8_t pkt[BENCH_MTU];
+    struct ip4_hdr *ip = (struct ip4_hdr *)pkt;
+    struct udp_hdr *udp = (struct udp_hdr *)(pkt + sizeof (*ip));
+    unsigned int sum;
+
+    ip4_hdr_init (ip, IPPROTO_UDP, sizeof (*ip) + sizeof (*udp) + len);
+
+    udp->sport = htons (sport);
+    udp->dport = htons (7);
+    udp->len = htons (sizeof (*udp) + len);
+    udp->sum = 0;
+    memcpy (pkt + sizeof (*ip) + sizeof (*udp), data, len);
+
+    sum = checksum_pseudo (BENCH_SADDR, BENCH_DADDR, IPPROTO_UDP,
+                           sizeof (*udp) + len);
+    sum = checksum_step (sum, udp, sizeof (*udp) + len);
+    udp->sum = checksum_fold (sum);
+
+    return write (tun_fd, pkt, sizeof (*ip) + sizeof (*udp) + len);
+}
+
+/*
+ * Pull one packet out of the tun side; returns payload protocol or -1
+ * when nothing is pending within the timeout.
+ */
+static int
+tun_packet_recv (uint8_t *pkt, size_t size, int timeout)
+{
+    struct pollfd pfd = { .fd = tun_fd, .events = POLLIN };
+    struct ip4_hdr *ip = (struct ip4_hdr *)pkt;
+    ssize_t s;
+
+    if (poll (&pfd, 1, timeout) <= 0)
+        return -1;
+
+    s = read (tun_fd, pkt, size);
+    if (s < (ssize_t)sizeof (*ip))
+        return -1;
+
+    return ip->proto;
+}
+
+/* loopback SOCKS5 server: no-auth, CONNECT sinks, ASSOCIATE echoes */
+
+static void *
+socks_tcp_session (void *data)
+{
+    int fd = (intptr_t)data;
+    uint8_t buf[65536];
+    ssize_t s;
+
+    s = recv (fd, buf, sizeof (buf), 0); /* greeting */
+    if (s < 2)
+        goto exit;
+    send (fd, "\x05\x00", 2, 0);
+
+    s = recv (fd, buf, sizeof (buf), 0); /* request */
+    if (s < 4)
+        goto exit;
+
+    if (buf[1] == 0x01) { /* connect: reply and sink */
+        uint8_t res[10] = { 5, 0, 0, 1, 127, 0, 0, 1, 0, 0 };
+
+        send (fd, res, sizeof (res), 0);
+        for (;;) {
+            s = recv (fd, buf, sizeof (buf), 0);
+            if (s <= 0)
+                break;
+        }
+    } else if (buf[1] == 0x03) { /* associate: udp echo */
+        uint8_t res[10] = { 5, 0, 0, 1, 127, 0, 0, 1, 0, 0 };
+        struct sockaddr_in addr = { 0 };
+        socklen_t alen = sizeof (addr);
+        int ufd;
+
+        ufd = socket (AF_INET, SOCK_DGRAM, 0);
+        if (ufd < 0)
+            goto exit;
+
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+        bind (ufd, (struct sockaddr *)&addr, sizeof (addr));
+        getsockname (ufd, (struct sockaddr *)&addr, &alen);
+        memcpy (&res[8], &addr.sin_port, 2);
+        send (fd, res, sizeof (res), 0);
+
+        for (;;) {
+            struct sockaddr_in peer;
+            struct pollfd pfds[2];
+
+            pfds[0].fd = fd;
+            pfds[0].events = POLLIN;
+            pfds[1].fd = ufd;
+            pfds[1].events = POLLIN;
+            if (poll (pfds, 2, -1) <= 0)
+                break;
+            if (pfds[0].revents) /* control closed */
+                break;
+
+            alen = sizeof (peer);
+            s = recvfrom (ufd, buf, sizeof (buf), 0,
+                          (struct sockaddr *)&peer, &alen);
+            if (s <= 0)
+                break;
+            sendto (ufd, buf, s, 0, (struct sockaddr *)&peer, alen);
+        }
+        close (ufd);
+    }
+
+exit:
+    close (fd);
+    return NULL;
+}
+
+static void *
+socks_server_entry (void *data)
+{
+    int fd = (intptr_t)data;
+
+    for (;;) {
+        pthread_t thread;
+        int cfd;
+
+        cfd = accept (fd, NULL, NULL);
+        if (cfd < 0)
+            break;
+
+        pthread_create (&thread, NULL, socks_tcp_session,
+                        (void *)(intptr_t)cfd);
+        pthread_detach (thread);
+    }
+
+    return NULL;
+}
+
+static int
+socks_server_init (void)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t alen = sizeof (addr);
+    pthread_t thread;
+    int fd;
+
+    fd = socket (AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        return -1;
+    if (listen (fd, 64) < 0)
+        return -1;
+
+    getsockname (fd, (struct sockaddr *)&addr, &alen);
+    socks_port = ntohs (addr.sin_port);
+
+    pthread_create (&thread, NULL, socks_server_entry, (void *)(intptr_t)fd);
+    pthread_detach (thread);
+
+    return 0;
+}
+
+static void *
+tunnel_entry (void *data)
+{
+    hev_socks5_tunnel_run ();
+    return NULL;
+}
+
+static int
+tunnel_start (void)
+{
+    char path[] = "/tmp/hev-socks5-tunnel-bench-XXXXXX";
+    pthread_t thread;
+    int sv[2];
+    FILE *fp;
+    int fd;
+
+    if (socks_server_init () < 0) {
+        fprintf (stderr, "bench: socks server\n");
+        return -1;
+    }
+
+    fd = mkstemp (path);
+    if (fd < 0)
+        return -1;
+    fp = fdopen (fd, "w");
+    fprintf (fp, "tunnel:\n");
+    fprintf (fp, "  mtu: %u\n", BENCH_MTU);
+    fprintf (fp, "  ipv4:\n");
+    fprintf (fp, "    address: 10.99.0.1\n");
+    fprintf (fp, "    gateway: 10.99.0.2\n");
+    fprintf (fp, "    prefix: 24\n");
+    fprintf (fp, "socks5:\n");
+    fprintf (fp, "  address: 127.0.0.1\n");
+    fprintf (fp, "  port: %d\n", socks_port);
+    fprintf (fp, "misc:\n");
+    fprintf (fp, "  log-level: error\n");
+    fclose (fp);
+
+    if (hev_config_init (path) < 0) {
+        fprintf (stderr, "bench: config\n");
+        return -1;
+    }
+    unlink (path);
+
+    if (socketpair (AF_UNIX, SOCK_DGRAM, 0, sv) < 0)
+        return -1;
+    tun_fd = sv[0];
+
+    /* the tunnel expects a non-blocking TUN fd: the batched reader
+     * issues up to batch-size reads per wakeup and relies on EAGAIN */
+    fcntl (sv[1], F_SETFL, O_NONBLOCK);
+
+    if (hev_socks5_tunnel_init (sv[1]) < 0) {
+        fprintf (stderr, "bench: tunnel init\n");
+        return -1;
+    }
+
+    pthread_create (&thread, NULL, tunnel_entry, NULL);
+    pthread_detach (thread);
+    usleep (100000);
+
+    return 0;
+}
+
+/*
+ * Open one connection through the tunnel; returns the server initial
+ * sequence number via isn, or -1 when the handshake times out.
+ */
+static int
+tcp_handshake (uint16_t sport, uint32_t seq, uint32_t *isn)
+{
+    uint8_t pkt[BENCH_MTU];
+    int i;
+
+    tcp_packet_send (sport, seq, 0, TCP_FLAG_SYN, NULL, 0);
+
+    for (i = 0; i < 1000; i++) {
+        struct ip4_hdr *ip = (struct ip4_hdr *)pkt;
+        struct tcp_hdr *tcp;
+
+        if (tun_packet_recv (pkt, sizeof (pkt), 10) != IPPROTO_TCP)
+            continue;
+
+        tcp = (struct tcp_hdr *)(pkt + ((ip->vhl & 0xf) * 4));
+        if (ntohs (tcp->dport) != sport)
+            continue;
+        if (!(tcp->flags & TCP_FLAG_SYN) || !(tcp->flags & TCP_FLAG_ACK))
+            continue;
+
+        *isn = ntohl (tcp->seq);
+        tcp_packet_send (sport, seq + 1, *isn + 1, TCP_FLAG_ACK, NULL, 0);
+        return 0;
+    }
+
+    return -1;
+}
+
+static void
+bench_tcp_bulk (void)
+{
+    uint8_t payload[BENCH_MSS];
+    uint8_t pkt[BENCH_MTU];
+    uint64_t start, end, bytes = 0, pkts = 0;
+    uint32_t seq = 1000, una = 1000, isn;
+    uint32_t misses;
+    uint16_t sport = 10001;
+
+    if (tcp_handshake (sport, seq - 1, &isn) < 0) {
+        fprintf (stderr, "bench: tcp handshake\n");
+        return;
+    }
+
+    memset (payload, 0x5a, sizeof (payload));
+    misses = hev_pbuf_pool_get_misses ();
+    start = now_us ();
+    end = start + BENCH_DURATION * 1000000;
+
+    while (now_us () < end) {
+        while (seq - una < BENCH_WINDOW) {
+            if (tcp_packet_send (sport, seq, isn + 1,
+                                 TCP_FLAG_ACK, payload,
+                                 sizeof (payload)) <= 0)
+                break;
+            seq += sizeof (payload);
+            bytes += sizeof (payload);
+            pkts++;
+        }
+
+        while (tun_packet_recv (pkt, sizeof (pkt), 1) == IPPROTO_TCP) {
+            struct ip4_hdr *ip = (struct ip4_hdr *)pkt;
+            struct tcp_hdr *tcp;
+
+            tcp = (struct tcp_hdr *)(pkt + ((ip->vhl & 0xf) * 4));
+            if (ntohs (tcp->dport) != sport)
+                continue;
+            if (tcp->flags & TCP_FLAG_ACK)
+                una = ntohl (tcp->ack);
+        }
+    }
+
+    end = now_us ();
+    misses = hev_pbuf_pool_get_misses () - misses;
+    printf ("tcp-bulk: %.3f Gbps, %.0f pps, %.3f allocs/pkt\n",
+            bytes * 8.0 / (end - start) / 1000,
+            pkts * 1000000.0 / (end - start),
+            pkts ? (double)misses / pkts : 0.0);
+
+    tcp_packet_send (sport, seq, isn + 1, TCP_FLAG_RST, NULL, 0);
+}
+
+static void
+bench_tcp_churn (void)
+{
+    uint64_t start, end, conns = 0;
+    uint16_t sport = 20000;
+
+    start = now_us ();
+    end = start + BENCH_DURATION * 1000000;
+
+    while (now_us () < end) {
+        uint32_t isn;
+
+        if (tcp_handshake (sport, 1000, &isn) == 0) {
+            tcp_packet_send (sport, 1001, isn + 1, TCP_FLAG_RST, NULL, 0);
+            conns++;
+        }
+        sport = (sport < 60000) ? sport + 1 : 20000;
+    }
+
+    end = now_us ();
+    printf ("tcp-churn: %.0f conns/s\n", conns * 1000000.0 / (end - start));
+}
+
+static int
+latency_compare (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void
+bench_udp_flood (void)
+{
+    uint64_t *samples;
+    uint64_t start, end, sent = 0, recvd = 0;
+    uint8_t pkt[BENCH_MTU];
+    uint16_t sport = 30001;
+
+    samples = malloc (sizeof (uint64_t) * BENCH_UDP_SAMPLES);
+    if (!samples)
+        return;
+
+    start = now_us ();
+    end = start + BENCH_DURATION * 1000000;
+
+    while (now_us () < end) {
+        while (sent - recvd < BENCH_UDP_INFLIGHT) {
+            uint64_t ts = now_us ();
+
+            if (udp_packet_send (sport, &ts, sizeof (ts)) <= 0)
+                break;
+            sent++;
+        }
+
+        while (tun_packet_recv (pkt, sizeof (pkt), 1) == IPPROTO_UDP) {
+            struct ip4_hdr *ip = (struct ip4_hdr *)pkt;
+            uint8_t *data = pkt + ((ip->vhl & 0xf) * 4) + 8;
+            uint64_t ts;
+
+            memcpy (&ts, data, sizeof (ts));
+            if (recvd < BENCH_UDP_SAMPLES)
+                samples[recvd] = now_us () - ts;
+            recvd++;
+        }
+    }
+
+    end = now_us ();
+    if (recvd) {
+        uint64_t n = (recvd < BENCH_UDP_SAMPLES) ? recvd : BENCH_UDP_SAMPLES;
+
+        qsort (samples, n, sizeof (uint64_t), latency_compare);
+        printf ("udp-flood: %.0f pps, p99 %lu us, loss %.2f%%\n",
+                recvd * 1000000.0 / (end - start),
+                (unsigned long)samples[n * 99 / 100],
+                (sent - recvd) * 100.0 / sent);
+    } else {
+        printf ("udp-flood: no replies\n");
+    }
+    free (samples);
+}
+
+/* scalar reference for the checksum kernel comparison */
+static uint16_t
+checksum_scalar (const uint8_t *pb, int len)
+{
+    uint32_t sum = 0;
+
+    while (len > 1) {
+        uint16_t w;
+
+        memcpy (&w, pb, 2);
+        sum += w;
+        pb += 2;
+        len -= 2;
+    }
+    if (len > 0)
+        sum += *pb;
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return sum;
+}
+
+static void
+bench_checksum (void)
+{
+    static const int sizes[] = { 64, 256, 1500, 8500, 65536 };
+    uint8_t *buf;
+    unsigned int i;
+
+    buf = malloc (65536);
+    if (!buf)
+        return;
+    for (i = 0; i < 65536; i++)
+        buf[i] = i * 2654435761u;
+
+    for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+        const int len = sizes[i];
+        const int iters = (64 << 20) / len;
+        volatile uint16_t sink;
+        uint64_t t0, t1, t2;
+        int j;
+
+        t0 = now_us ();
+        for (j = 0; j < iters; j++)
+            sink = checksum_scalar (buf, len);
+        t1 = now_us ();
+        for (j = 0; j < iters; j++)
+            sink = hev_checksum (buf, len);
+        t2 = now_us ();
+        (void)sink;
+
+        if (checksum_scalar (buf, len) != hev_checksum (buf, len)) {
+            printf ("checksum: MISMATCH at %d bytes\n", len);
+            continue;
+        }
+
+        printf ("checksum: %6d B  scalar %6.2f GB/s  simd %6.2f GB/s  "
+                "x%.2f\n",
+                len, (uint64_t)iters * len / (double)(t1 - t0) / 1000.0,
+                (uint64_t)iters * len / (double)(t2 - t1) / 1000.0,
+                (double)(t1 - t0) / (t2 - t1));
+    }
+
+    free (buf);
+}
+
+int
+main (int argc, char *argv[])
+{
+    bench_checksum ();
+
+    if (tunnel_start () < 0)
+        return -1;
+
+    bench_tcp_bulk ();
+    bench_tcp_churn ();
+    bench_udp_flood ();
+
+    hev_socks5_tunnel_stop ();
+    return 0;
+}
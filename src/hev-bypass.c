@@ -0,0 +1,138 @@
+/*
+ ============================================================================
+ Name        : hev-bypass.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Bypass
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "hev-trie.h"
+#include "hev-config.h"
+#include "hev-logger.h"
+
+#include "hev-bypass.h"
+
+static HevTrie *trie4;
+static HevTrie *trie6;
+
+static int
+bypass_parse_rule (const char *rule)
+{
+    char addr[64];
+    uint8_t bytes[16];
+    const char *slash;
+    unsigned int plen;
+    size_t alen;
+
+    slash = strchr (rule, '/');
+    if (slash) {
+        alen = slash - rule;
+        plen = strtoul (slash + 1, NULL, 10);
+    } else {
+        alen = strlen (rule);
+        plen = ~0u;
+    }
+
+    if (alen >= sizeof (addr))
+        return -1;
+    memcpy (addr, rule, alen);
+    addr[alen] = '\0';
+
+    if (inet_pton (AF_INET, addr, bytes) == 1) {
+        if (plen == ~0u)
+            plen = 32;
+        if (plen > 32)
+            return -1;
+        return hev_trie_add (trie4, bytes, plen);
+    }
+
+    if (inet_pton (AF_INET6, addr, bytes) == 1) {
+        if (plen == ~0u)
+            plen = 128;
+        if (plen > 128)
+            return -1;
+        return hev_trie_add (trie6, bytes, plen);
+    }
+
+    return -1;
+}
+
+int
+hev_bypass_init (void)
+{
+    int count;
+    int i;
+
+    count = hev_config_get_bypass_count ();
+    if (!count)
+        return 0;
+
+    LOG_D ("bypass init");
+
+    trie4 = hev_trie_new (count);
+    if (!trie4) {
+        LOG_E ("bypass trie");
+        return -1;
+    }
+
+    trie6 = hev_trie_new (count);
+    if (!trie6) {
+        LOG_E ("bypass trie");
+        hev_trie_destroy (trie4);
+        trie4 = NULL;
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        const char *rule = hev_config_get_bypass_rule (i);
+
+        if (bypass_parse_rule (rule) < 0)
+            LOG_W ("bypass rule %s", rule);
+    }
+
+    return 0;
+}
+
+void
+hev_bypass_fini (void)
+{
+    if (!trie4)
+        return;
+
+    LOG_D ("bypass fini");
+
+    hev_trie_destroy (trie4);
+    hev_trie_destroy (trie6);
+    trie4 = NULL;
+    trie6 = NULL;
+}
+
+/*
+ * Rebuild the tries after a config reload; safe because lookups only
+ * run on the main task thread and this never yields.
+ */
+int
+hev_bypass_reload (void)
+{
+    hev_bypass_fini ();
+
+    return hev_bypass_init ();
+}
+
+int
+hev_bypass_match (const uint8_t *addr, uint8_t family)
+{
+    if (!trie4)
+        return 0;
+
+    if (family == 6)
+        return hev_trie_match (trie6, addr, 128);
+
+    return hev_trie_match (trie4, addr, 32);
+}
@@ -0,0 +1,26 @@
+/*
+ ============================================================================
+ Name        : hev-bypass.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Bypass
+ ============================================================================
+ */
+
+#ifndef __HEV_BYPASS_H__
+#define __HEV_BYPASS_H__
+
+#include <stdint.h>
+
+int hev_bypass_init (void);
+void hev_bypass_fini (void);
+int hev_bypass_reload (void);
+
+/*
+ * Longest-prefix match of a destination against the configured CIDR
+ * rules; addr is the wire-order address bytes and family the session
+ * key family (0 = v4, 6 = v6). Bit probes only, no allocations.
+ */
+int hev_bypass_match (const uint8_t *addr, uint8_t family);
+
+#endif /* __HEV_BYPASS_H__ */
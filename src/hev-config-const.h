@@ -14,8 +14,46 @@
 #define MINOR_VERSION (0)
 #define MICRO_VERSION (3)
 
-static const int TCP_BUF_SIZE = 8192;
+/*
+ * Build profiles (make PROFILE=memory / PROFILE=throughput) specialize
+ * the pool geometry and splice buffer defaults at compile time; the
+ * same HEV_PROFILE_* macro is forwarded to the vendored lwip build so
+ * its lwipopts.h can size pcb counts and windows to match. The default
+ * profile keeps the historical values.
+ */
+#if defined(HEV_PROFILE_MEMORY)
+
+static const int UDP_BUF_SIZE = 1500;
+static const int UDP_POOL_SIZE = 128;
+static const int PBUF_SLAB_COUNT = 128;
+static const int SPLICE_ARENA_COUNT = 64;
+static const int VNET_BUF_SIZE = 65550;
+
+#define TASK_STACK_SIZE_DEFAULT (8192)
+#define TCP_BUFFER_SIZE_DEFAULT (4096)
+
+#elif defined(HEV_PROFILE_THROUGHPUT)
+
+static const int UDP_BUF_SIZE = 1500;
+static const int UDP_POOL_SIZE = 2048;
+static const int PBUF_SLAB_COUNT = 2048;
+static const int SPLICE_ARENA_COUNT = 1024;
+static const int VNET_BUF_SIZE = 65550;
+
+#define TASK_STACK_SIZE_DEFAULT (20480)
+#define TCP_BUFFER_SIZE_DEFAULT (65536)
+
+#else
+
 static const int UDP_BUF_SIZE = 1500;
 static const int UDP_POOL_SIZE = 512;
+static const int PBUF_SLAB_COUNT = 512;
+static const int SPLICE_ARENA_COUNT = 256;
+static const int VNET_BUF_SIZE = 65550;
+
+#define TASK_STACK_SIZE_DEFAULT (20480)
+#define TCP_BUFFER_SIZE_DEFAULT (8192)
+
+#endif
 
 #endif /* __HEV_CONFIG_CONST_H__ */
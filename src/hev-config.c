@@ -8,14 +8,23 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
 #include <yaml.h>
 
 #include "hev-logger.h"
 #include "hev-config.h"
+#include "hev-config-const.h"
+
+static char config_path[1024];
 
 static char tun_name[64];
 static unsigned int tun_mtu = 8192;
+static unsigned int tun_multi_queue = 1;
+static int tun_vnet_hdr;
 
 static char tun_ipv4_address[16];
 static char tun_ipv4_gateway[16];
@@ -30,12 +39,40 @@ static char srv_port[8];
 
 static char log_file[1024];
 static char pid_file[1024];
-static int task_stack_size = 20480;
+static char stats_file[1024];
+static int task_stack_size = TASK_STACK_SIZE_DEFAULT;
+static int tun_batch_size = 64;
+static int tcp_zero_copy;
+static int io_uring;
+static int tcp_buffer_size = TCP_BUFFER_SIZE_DEFAULT;
+static int tcp_recv_window;
+static int udp_batch_size = 64;
+static int workers = 1;
+static int socks5_pool;
+static int udp_relays;
 static int connect_timeout = 5000;
 static int read_write_timeout = 60000;
 static int limit_nofile = -2;
 static int log_level = HEV_LOGGER_WARN;
 
+#define BYPASS_RULES_MAX (256)
+static char bypass_rules[BYPASS_RULES_MAX][48];
+static int bypass_count;
+
+#define FILTER_RULES_MAX (256)
+static char filter_rules[FILTER_RULES_MAX][64];
+static int filter_count;
+
+#define PRIORITY_PORTS_MAX (64)
+#define CPU_AFFINITY_MAX (64)
+static uint16_t priority_ports[PRIORITY_PORTS_MAX];
+static int priority_ports_count;
+static int32_t cpu_affinity[CPU_AFFINITY_MAX];
+static int cpu_affinity_count;
+static int tcp_splice_budget;
+static int session_limit;
+static int busy_poll;
+
 static int
 hev_config_parse_tunnel_ipv4 (yaml_document_t *doc, yaml_node_t *base)
 {
@@ -142,6 +179,10 @@ hev_config_parse_tunnel (yaml_document_t *doc, yaml_node_t *base)
                 strncpy (tun_name, value, 64 - 1);
             else if (0 == strcmp (key, "mtu"))
                 tun_mtu = strtoul (value, NULL, 10);
+            else if (0 == strcmp (key, "multi-queue"))
+                tun_multi_queue = strtoul (value, NULL, 10);
+            else if (0 == strcmp (key, "vnet-hdr"))
+                tun_vnet_hdr = strtoul (value, NULL, 10);
         } else {
             if (0 == strcmp (key, "ipv4"))
                 hev_config_parse_tunnel_ipv4 (doc, node);
@@ -231,6 +272,42 @@ hev_config_parse_log_level (const char *value)
     return HEV_LOGGER_WARN;
 }
 
+static void
+hev_config_parse_priority_ports (const char *value)
+{
+    priority_ports_count = 0;
+
+    while (*value && priority_ports_count < PRIORITY_PORTS_MAX) {
+        char *end;
+        unsigned long port;
+
+        port = strtoul (value, &end, 10);
+        if (end == value)
+            break;
+        if (port && port <= 65535)
+            priority_ports[priority_ports_count++] = port;
+        value = (*end == ',') ? end + 1 : end;
+    }
+}
+
+static void
+hev_config_parse_cpu_affinity (const char *value)
+{
+    cpu_affinity_count = 0;
+
+    while (*value && cpu_affinity_count < CPU_AFFINITY_MAX) {
+        char *end;
+        unsigned long core;
+
+        core = strtoul (value, &end, 10);
+        if (end == value)
+            break;
+        if (core < 4096)
+            cpu_affinity[cpu_affinity_count++] = core;
+        value = (*end == ',') ? end + 1 : end;
+    }
+}
+
 static int
 hev_config_parse_misc (yaml_document_t *doc, yaml_node_t *base)
 {
@@ -259,12 +336,42 @@ hev_config_parse_misc (yaml_document_t *doc, yaml_node_t *base)
 
         if (0 == strcmp (key, "task-stack-size"))
             task_stack_size = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "tun-batch-size"))
+            tun_batch_size = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "tcp-zero-copy"))
+            tcp_zero_copy = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "io-uring"))
+            io_uring = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "priority-ports"))
+            hev_config_parse_priority_ports (value);
+        else if (0 == strcmp (key, "tcp-splice-budget"))
+            tcp_splice_budget = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "session-limit"))
+            session_limit = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "cpu-affinity"))
+            hev_config_parse_cpu_affinity (value);
+        else if (0 == strcmp (key, "busy-poll"))
+            busy_poll = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "tcp-buffer-size"))
+            tcp_buffer_size = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "tcp-recv-window"))
+            tcp_recv_window = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "udp-batch-size"))
+            udp_batch_size = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "workers"))
+            workers = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "socks5-pool"))
+            socks5_pool = strtoul (value, NULL, 10);
+        else if (0 == strcmp (key, "udp-relays"))
+            udp_relays = strtoul (value, NULL, 10);
         else if (0 == strcmp (key, "connect-timeout"))
             connect_timeout = strtoul (value, NULL, 10);
         else if (0 == strcmp (key, "read-write-timeout"))
             read_write_timeout = strtoul (value, NULL, 10);
         else if (0 == strcmp (key, "pid-file"))
             strncpy (pid_file, value, 1024 - 1);
+        else if (0 == strcmp (key, "stats-file"))
+            strncpy (stats_file, value, 1024 - 1);
         else if (0 == strcmp (key, "log-file"))
             strncpy (log_file, value, 1024 - 1);
         else if (0 == strcmp (key, "log-level"))
@@ -277,7 +384,63 @@ hev_config_parse_misc (yaml_document_t *doc, yaml_node_t *base)
 }
 
 static int
-hev_config_parse_doc (yaml_document_t *doc)
+hev_config_parse_bypass (yaml_document_t *doc, yaml_node_t *base)
+{
+    yaml_node_item_t *item;
+
+    if (!base || YAML_SEQUENCE_NODE != base->type)
+        return -1;
+
+    bypass_count = 0;
+    for (item = base->data.sequence.items.start;
+         item < base->data.sequence.items.top; item++) {
+        yaml_node_t *node;
+
+        node = yaml_document_get_node (doc, *item);
+        if (!node || YAML_SCALAR_NODE != node->type)
+            break;
+
+        if (bypass_count >= BYPASS_RULES_MAX)
+            break;
+
+        strncpy (bypass_rules[bypass_count],
+                 (const char *)node->data.scalar.value, 48 - 1);
+        bypass_count++;
+    }
+
+    return 0;
+}
+
+static int
+hev_config_parse_filter (yaml_document_t *doc, yaml_node_t *base)
+{
+    yaml_node_item_t *item;
+
+    if (!base || YAML_SEQUENCE_NODE != base->type)
+        return -1;
+
+    filter_count = 0;
+    for (item = base->data.sequence.items.start;
+         item < base->data.sequence.items.top; item++) {
+        yaml_node_t *node;
+
+        node = yaml_document_get_node (doc, *item);
+        if (!node || YAML_SCALAR_NODE != node->type)
+            break;
+
+        if (filter_count >= FILTER_RULES_MAX)
+            break;
+
+        strncpy (filter_rules[filter_count],
+                 (const char *)node->data.scalar.value, 64 - 1);
+        filter_count++;
+    }
+
+    return 0;
+}
+
+static int
+hev_config_parse_doc (yaml_document_t *doc, int reload)
 {
     yaml_node_t *root;
     yaml_node_pair_t *pair;
@@ -303,11 +466,15 @@ hev_config_parse_doc (yaml_document_t *doc)
         node = yaml_document_get_node (doc, pair->value);
 
         if (0 == strcmp (key, "tunnel"))
-            res = hev_config_parse_tunnel (doc, node);
+            res = reload ? 0 : hev_config_parse_tunnel (doc, node);
         else if (0 == strcmp (key, "socks5"))
             res = hev_config_parse_socks5 (doc, node);
         else if (0 == strcmp (key, "misc"))
             res = hev_config_parse_misc (doc, node);
+        else if (0 == strcmp (key, "bypass"))
+            res = hev_config_parse_bypass (doc, node);
+        else if (0 == strcmp (key, "filter"))
+            res = hev_config_parse_filter (doc, node);
 
         if (res < 0)
             return -1;
@@ -316,8 +483,250 @@ hev_config_parse_doc (yaml_document_t *doc)
     return 0;
 }
 
-int
-hev_config_init (const char *config_path)
+/*
+ * Binary config cache: a flat copy of the parsed settings keyed on the
+ * source file identity, so restarts skip the YAML parse entirely.
+ */
+
+#define CONFIG_CACHE_MAGIC (0x48535443)
+#define CONFIG_CACHE_VERSION (6)
+
+typedef struct _HevConfigCache HevConfigCache;
+
+struct _HevConfigCache
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t src_size;
+    uint64_t src_mtime;
+
+    char tun_name[64];
+    uint32_t tun_mtu;
+    uint32_t tun_multi_queue;
+    int32_t tun_vnet_hdr;
+
+    char tun_ipv4_address[16];
+    char tun_ipv4_gateway[16];
+    uint32_t tun_ipv4_prefix;
+
+    char tun_ipv6_address[64];
+    char tun_ipv6_gateway[64];
+    uint32_t tun_ipv6_prefix;
+
+    char srv_address[256];
+    char srv_port[8];
+
+    char log_file[1024];
+    char pid_file[1024];
+    char stats_file[1024];
+    int32_t task_stack_size;
+    int32_t tun_batch_size;
+    int32_t tcp_zero_copy;
+    int32_t io_uring;
+    int32_t tcp_buffer_size;
+    int32_t tcp_recv_window;
+    int32_t udp_batch_size;
+    int32_t workers;
+    int32_t socks5_pool;
+    int32_t udp_relays;
+    int32_t connect_timeout;
+    int32_t read_write_timeout;
+    int32_t limit_nofile;
+    int32_t log_level;
+
+    int32_t bypass_count;
+    char bypass_rules[BYPASS_RULES_MAX][48];
+
+    int32_t filter_count;
+    char filter_rules[FILTER_RULES_MAX][64];
+
+    int32_t priority_ports_count;
+    uint16_t priority_ports[PRIORITY_PORTS_MAX];
+    int32_t tcp_splice_budget;
+    int32_t session_limit;
+
+    int32_t cpu_affinity_count;
+    int32_t cpu_affinity[CPU_AFFINITY_MAX];
+    int32_t busy_poll;
+};
+
+static void
+hev_config_cache_path (char *path, size_t size)
+{
+    snprintf (path, size, "%s.cache", config_path);
+}
+
+static int
+hev_config_cache_load (const struct stat *st)
+{
+    char path[1088];
+    HevConfigCache cache;
+    size_t res;
+    FILE *fp;
+    int i;
+
+    hev_config_cache_path (path, sizeof (path));
+    fp = fopen (path, "r");
+    if (!fp)
+        return -1;
+
+    res = fread (&cache, sizeof (cache), 1, fp);
+    fclose (fp);
+
+    if (res != 1 || cache.magic != CONFIG_CACHE_MAGIC ||
+        cache.version != CONFIG_CACHE_VERSION ||
+        cache.src_size != (uint64_t)st->st_size ||
+        cache.src_mtime != (uint64_t)st->st_mtime)
+        return -1;
+
+    /* a truncated or corrupted cache must not yield unterminated
+     * strings; the counts are clamped below, terminate these too */
+    memcpy (tun_name, cache.tun_name, sizeof (tun_name));
+    tun_name[sizeof (tun_name) - 1] = '\0';
+    tun_mtu = cache.tun_mtu;
+    tun_multi_queue = cache.tun_multi_queue;
+    tun_vnet_hdr = cache.tun_vnet_hdr;
+    memcpy (tun_ipv4_address, cache.tun_ipv4_address,
+            sizeof (tun_ipv4_address));
+    tun_ipv4_address[sizeof (tun_ipv4_address) - 1] = '\0';
+    memcpy (tun_ipv4_gateway, cache.tun_ipv4_gateway,
+            sizeof (tun_ipv4_gateway));
+    tun_ipv4_gateway[sizeof (tun_ipv4_gateway) - 1] = '\0';
+    tun_ipv4_prefix = cache.tun_ipv4_prefix;
+    memcpy (tun_ipv6_address, cache.tun_ipv6_address,
+            sizeof (tun_ipv6_address));
+    tun_ipv6_address[sizeof (tun_ipv6_address) - 1] = '\0';
+    memcpy (tun_ipv6_gateway, cache.tun_ipv6_gateway,
+            sizeof (tun_ipv6_gateway));
+    tun_ipv6_gateway[sizeof (tun_ipv6_gateway) - 1] = '\0';
+    tun_ipv6_prefix = cache.tun_ipv6_prefix;
+    memcpy (srv_address, cache.srv_address, sizeof (srv_address));
+    srv_address[sizeof (srv_address) - 1] = '\0';
+    memcpy (srv_port, cache.srv_port, sizeof (srv_port));
+    srv_port[sizeof (srv_port) - 1] = '\0';
+    memcpy (log_file, cache.log_file, sizeof (log_file));
+    log_file[sizeof (log_file) - 1] = '\0';
+    memcpy (pid_file, cache.pid_file, sizeof (pid_file));
+    pid_file[sizeof (pid_file) - 1] = '\0';
+    memcpy (stats_file, cache.stats_file, sizeof (stats_file));
+    stats_file[sizeof (stats_file) - 1] = '\0';
+    task_stack_size = cache.task_stack_size;
+    tun_batch_size = cache.tun_batch_size;
+    tcp_zero_copy = cache.tcp_zero_copy;
+    io_uring = cache.io_uring;
+    tcp_buffer_size = cache.tcp_buffer_size;
+    tcp_recv_window = cache.tcp_recv_window;
+    udp_batch_size = cache.udp_batch_size;
+    workers = cache.workers;
+    socks5_pool = cache.socks5_pool;
+    udp_relays = cache.udp_relays;
+    connect_timeout = cache.connect_timeout;
+    read_write_timeout = cache.read_write_timeout;
+    limit_nofile = cache.limit_nofile;
+    log_level = cache.log_level;
+    bypass_count = cache.bypass_count;
+    if (bypass_count > BYPASS_RULES_MAX)
+        bypass_count = BYPASS_RULES_MAX;
+    memcpy (bypass_rules, cache.bypass_rules, sizeof (bypass_rules));
+    for (i = 0; i < BYPASS_RULES_MAX; i++)
+        bypass_rules[i][sizeof (bypass_rules[i]) - 1] = '\0';
+    filter_count = cache.filter_count;
+    if (filter_count > FILTER_RULES_MAX)
+        filter_count = FILTER_RULES_MAX;
+    memcpy (filter_rules, cache.filter_rules, sizeof (filter_rules));
+    for (i = 0; i < FILTER_RULES_MAX; i++)
+        filter_rules[i][sizeof (filter_rules[i]) - 1] = '\0';
+    priority_ports_count = cache.priority_ports_count;
+    if (priority_ports_count > PRIORITY_PORTS_MAX)
+        priority_ports_count = PRIORITY_PORTS_MAX;
+    memcpy (priority_ports, cache.priority_ports, sizeof (priority_ports));
+    tcp_splice_budget = cache.tcp_splice_budget;
+    session_limit = cache.session_limit;
+    cpu_affinity_count = cache.cpu_affinity_count;
+    if (cpu_affinity_count > CPU_AFFINITY_MAX)
+        cpu_affinity_count = CPU_AFFINITY_MAX;
+    memcpy (cpu_affinity, cache.cpu_affinity, sizeof (cpu_affinity));
+    busy_poll = cache.busy_poll;
+
+    return 0;
+}
+
+static void
+hev_config_cache_save (const struct stat *st)
+{
+    char path[1088];
+    char temp[1100];
+    HevConfigCache cache = { 0 };
+    FILE *fp;
+
+    cache.magic = CONFIG_CACHE_MAGIC;
+    cache.version = CONFIG_CACHE_VERSION;
+    cache.src_size = st->st_size;
+    cache.src_mtime = st->st_mtime;
+
+    memcpy (cache.tun_name, tun_name, sizeof (tun_name));
+    cache.tun_mtu = tun_mtu;
+    cache.tun_multi_queue = tun_multi_queue;
+    cache.tun_vnet_hdr = tun_vnet_hdr;
+    memcpy (cache.tun_ipv4_address, tun_ipv4_address,
+            sizeof (tun_ipv4_address));
+    memcpy (cache.tun_ipv4_gateway, tun_ipv4_gateway,
+            sizeof (tun_ipv4_gateway));
+    cache.tun_ipv4_prefix = tun_ipv4_prefix;
+    memcpy (cache.tun_ipv6_address, tun_ipv6_address,
+            sizeof (tun_ipv6_address));
+    memcpy (cache.tun_ipv6_gateway, tun_ipv6_gateway,
+            sizeof (tun_ipv6_gateway));
+    cache.tun_ipv6_prefix = tun_ipv6_prefix;
+    memcpy (cache.srv_address, srv_address, sizeof (srv_address));
+    memcpy (cache.srv_port, srv_port, sizeof (srv_port));
+    memcpy (cache.log_file, log_file, sizeof (log_file));
+    memcpy (cache.pid_file, pid_file, sizeof (pid_file));
+    memcpy (cache.stats_file, stats_file, sizeof (stats_file));
+    cache.task_stack_size = task_stack_size;
+    cache.tun_batch_size = tun_batch_size;
+    cache.tcp_zero_copy = tcp_zero_copy;
+    cache.io_uring = io_uring;
+    cache.tcp_buffer_size = tcp_buffer_size;
+    cache.tcp_recv_window = tcp_recv_window;
+    cache.udp_batch_size = udp_batch_size;
+    cache.workers = workers;
+    cache.socks5_pool = socks5_pool;
+    cache.udp_relays = udp_relays;
+    cache.connect_timeout = connect_timeout;
+    cache.read_write_timeout = read_write_timeout;
+    cache.limit_nofile = limit_nofile;
+    cache.log_level = log_level;
+    cache.bypass_count = bypass_count;
+    memcpy (cache.bypass_rules, bypass_rules, sizeof (bypass_rules));
+    cache.filter_count = filter_count;
+    memcpy (cache.filter_rules, filter_rules, sizeof (filter_rules));
+    cache.priority_ports_count = priority_ports_count;
+    memcpy (cache.priority_ports, priority_ports, sizeof (priority_ports));
+    cache.tcp_splice_budget = tcp_splice_budget;
+    cache.session_limit = session_limit;
+    cache.cpu_affinity_count = cpu_affinity_count;
+    memcpy (cache.cpu_affinity, cpu_affinity, sizeof (cpu_affinity));
+    cache.busy_poll = busy_poll;
+
+    hev_config_cache_path (path, sizeof (path));
+    snprintf (temp, sizeof (temp), "%s.tmp", path);
+
+    fp = fopen (temp, "w");
+    if (!fp)
+        return;
+
+    if (fwrite (&cache, sizeof (cache), 1, fp) == 1) {
+        fclose (fp);
+        rename (temp, path);
+    } else {
+        fclose (fp);
+        unlink (temp);
+    }
+}
+
+static int
+hev_config_parse_file (int reload)
 {
     yaml_parser_t parser;
     yaml_document_t doc;
@@ -339,7 +748,7 @@ hev_config_init (const char *config_path)
         goto exit_close_fp;
     }
 
-    res = hev_config_parse_doc (&doc);
+    res = hev_config_parse_doc (&doc, reload);
     yaml_document_delete (&doc);
 
 exit_close_fp:
@@ -350,6 +759,41 @@ exit:
     return res;
 }
 
+int
+hev_config_init (const char *path)
+{
+    struct stat st;
+    int res;
+
+    strncpy (config_path, path, sizeof (config_path) - 1);
+
+    if (stat (path, &st) == 0) {
+        if (hev_config_cache_load (&st) == 0)
+            return 0;
+    }
+
+    res = hev_config_parse_file (0);
+    if ((res == 0) && (stat (path, &st) == 0))
+        hev_config_cache_save (&st);
+
+    return res;
+}
+
+int
+hev_config_reload (void)
+{
+    struct stat st;
+    int res;
+
+    /* the tunnel section needs a device rebuild; only new sessions see
+     * the refreshed socks5 and misc settings */
+    res = hev_config_parse_file (1);
+    if ((res == 0) && (stat (config_path, &st) == 0))
+        hev_config_cache_save (&st);
+
+    return res;
+}
+
 void
 hev_config_fini (void)
 {
@@ -370,6 +814,21 @@ hev_config_get_tunnel_mtu (void)
     return tun_mtu;
 }
 
+unsigned int
+hev_config_get_tunnel_multi_queue (void)
+{
+    if (!tun_multi_queue)
+        return 1;
+
+    return tun_multi_queue;
+}
+
+int
+hev_config_get_tunnel_vnet_hdr (void)
+{
+    return tun_vnet_hdr;
+}
+
 const char *
 hev_config_get_tunnel_ipv4_address (void)
 {
@@ -432,6 +891,154 @@ hev_config_get_misc_task_stack_size (void)
     return task_stack_size;
 }
 
+int
+hev_config_get_misc_tcp_zero_copy (void)
+{
+    return tcp_zero_copy;
+}
+
+int
+hev_config_get_misc_io_uring (void)
+{
+    return io_uring;
+}
+
+int
+hev_config_get_misc_priority_ports (const uint16_t **ports)
+{
+    *ports = priority_ports;
+
+    return priority_ports_count;
+}
+
+int
+hev_config_get_misc_tcp_splice_budget (void)
+{
+    if (tcp_splice_budget && tcp_splice_budget < 4096)
+        return 4096;
+
+    return tcp_splice_budget;
+}
+
+int
+hev_config_get_misc_session_limit (void)
+{
+    return session_limit;
+}
+
+int
+hev_config_get_misc_cpu_affinity (const int32_t **cores)
+{
+    *cores = cpu_affinity;
+
+    return cpu_affinity_count;
+}
+
+int
+hev_config_get_misc_busy_poll (void)
+{
+    return busy_poll;
+}
+
+int
+hev_config_get_bypass_count (void)
+{
+    return bypass_count;
+}
+
+const char *
+hev_config_get_bypass_rule (int index)
+{
+    if (index < 0 || index >= bypass_count)
+        return NULL;
+
+    return bypass_rules[index];
+}
+
+int
+hev_config_get_filter_count (void)
+{
+    return filter_count;
+}
+
+const char *
+hev_config_get_filter_rule (int index)
+{
+    return filter_rules[index];
+}
+
+int
+hev_config_get_misc_tcp_buffer_size (void)
+{
+    if (tcp_buffer_size < 2048)
+        return 2048;
+    if (tcp_buffer_size > 1048576)
+        return 1048576;
+
+    return tcp_buffer_size;
+}
+
+int
+hev_config_get_misc_tcp_recv_window (void)
+{
+    return tcp_recv_window;
+}
+
+int
+hev_config_get_misc_workers (void)
+{
+    if (workers < 1)
+        return 1;
+    if (workers > 64)
+        return 64;
+
+    return workers;
+}
+
+int
+hev_config_get_misc_socks5_pool (void)
+{
+    if (socks5_pool < 0)
+        return 0;
+    if (socks5_pool > 64)
+        return 64;
+
+    return socks5_pool;
+}
+
+int
+hev_config_get_misc_udp_relays (void)
+{
+    if (udp_relays < 0)
+        return 0;
+    if (udp_relays > 16)
+        return 16;
+
+    return udp_relays;
+}
+
+int
+hev_config_get_misc_udp_batch_size (void)
+{
+    if (udp_batch_size < 1)
+        return 1;
+    if (udp_batch_size > 1024)
+        return 1024;
+
+    return udp_batch_size;
+}
+
+int
+hev_config_get_misc_tun_batch_size (void)
+{
+    if (tun_batch_size < 1)
+        return 1;
+    if (tun_batch_size > 1024)
+        return 1024;
+
+    return tun_batch_size;
+}
+
 int
 hev_config_get_misc_connect_timeout (void)
 {
@@ -459,6 +1066,15 @@ hev_config_get_misc_pid_file (void)
     return pid_file;
 }
 
+const char *
+hev_config_get_misc_stats_file (void)
+{
+    if (!stats_file[0])
+        return NULL;
+
+    return stats_file;
+}
+
 const char *
 hev_config_get_misc_log_file (void)
 {
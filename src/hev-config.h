@@ -10,11 +10,16 @@
 #ifndef __HEV_CONFIG_H__
 #define __HEV_CONFIG_H__
 
+#include <stdint.h>
+
 int hev_config_init (const char *config_path);
+int hev_config_reload (void);
 void hev_config_fini (void);
 
 const char *hev_config_get_tunnel_name (void);
 unsigned int hev_config_get_tunnel_mtu (void);
+unsigned int hev_config_get_tunnel_multi_queue (void);
+int hev_config_get_tunnel_vnet_hdr (void);
 
 const char *hev_config_get_tunnel_ipv4_address (void);
 const char *hev_config_get_tunnel_ipv4_gateway (void);
@@ -26,11 +31,31 @@ unsigned int hev_config_get_tunnel_ipv6_prefix (void);
 
 const char *hev_config_get_socks5_address (int *port);
 
+int hev_config_get_bypass_count (void);
+const char *hev_config_get_bypass_rule (int index);
+int hev_config_get_filter_count (void);
+const char *hev_config_get_filter_rule (int index);
+
 int hev_config_get_misc_task_stack_size (void);
+int hev_config_get_misc_tun_batch_size (void);
+int hev_config_get_misc_tcp_zero_copy (void);
+int hev_config_get_misc_io_uring (void);
+int hev_config_get_misc_priority_ports (const uint16_t **ports);
+int hev_config_get_misc_tcp_splice_budget (void);
+int hev_config_get_misc_session_limit (void);
+int hev_config_get_misc_cpu_affinity (const int32_t **cores);
+int hev_config_get_misc_busy_poll (void);
+int hev_config_get_misc_tcp_buffer_size (void);
+int hev_config_get_misc_tcp_recv_window (void);
+int hev_config_get_misc_udp_batch_size (void);
+int hev_config_get_misc_workers (void);
+int hev_config_get_misc_socks5_pool (void);
+int hev_config_get_misc_udp_relays (void);
 int hev_config_get_misc_connect_timeout (void);
 int hev_config_get_misc_read_write_timeout (void);
 int hev_config_get_misc_limit_nofile (void);
 const char *hev_config_get_misc_pid_file (void);
+const char *hev_config_get_misc_stats_file (void);
 const char *hev_config_get_misc_log_file (void);
 int hev_config_get_misc_log_level (void);
 
@@ -0,0 +1,218 @@
+/*
+ ============================================================================
+ Name        : hev-filter.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Packet Filter
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+
+#include <hev-memory-allocator.h>
+
+#include "hev-trie.h"
+#include "hev-config.h"
+#include "hev-logger.h"
+
+#include "hev-filter.h"
+
+typedef struct _HevFilterTable HevFilterTable;
+
+struct _HevFilterTable
+{
+    uint8_t ports[65536 / 8];
+    HevTrie *trie4;
+    HevTrie *trie6;
+};
+
+static HevFilterTable *allow;
+static HevFilterTable *deny;
+
+static void
+filter_table_destroy (HevFilterTable *table)
+{
+    if (!table)
+        return;
+
+    hev_trie_destroy (table->trie4);
+    hev_trie_destroy (table->trie6);
+    hev_free (table);
+}
+
+static HevFilterTable *
+filter_table_new (unsigned int prefixes)
+{
+    HevFilterTable *table;
+
+    table = hev_malloc0 (sizeof (HevFilterTable));
+    if (!table)
+        return NULL;
+
+    table->trie4 = hev_trie_new (prefixes);
+    table->trie6 = hev_trie_new (prefixes);
+    if (!table->trie4 || !table->trie6) {
+        filter_table_destroy (table);
+        return NULL;
+    }
+
+    return table;
+}
+
+static int
+filter_table_add (HevFilterTable *table, const char *spec)
+{
+    char addr[64];
+    uint8_t bytes[16];
+    const char *slash;
+    unsigned int plen;
+    size_t alen;
+
+    if (isdigit (spec[0]) && !strchr (spec, '.') && !strchr (spec, ':')) {
+        unsigned long port = strtoul (spec, NULL, 10);
+
+        if (!port || port > 65535)
+            return -1;
+        table->ports[port >> 3] |= 1 << (port & 7);
+        return 0;
+    }
+
+    slash = strchr (spec, '/');
+    if (slash) {
+        alen = slash - spec;
+        plen = strtoul (slash + 1, NULL, 10);
+    } else {
+        alen = strlen (spec);
+        plen = ~0u;
+    }
+
+    if (alen >= sizeof (addr))
+        return -1;
+    memcpy (addr, spec, alen);
+    addr[alen] = '\0';
+
+    if (inet_pton (AF_INET, addr, bytes) == 1) {
+        if (plen == ~0u)
+            plen = 32;
+        if (plen > 32)
+            return -1;
+        return hev_trie_add (table->trie4, bytes, plen);
+    }
+
+    if (inet_pton (AF_INET6, addr, bytes) == 1) {
+        if (plen == ~0u)
+            plen = 128;
+        if (plen > 128)
+            return -1;
+        return hev_trie_add (table->trie6, bytes, plen);
+    }
+
+    return -1;
+}
+
+static int
+filter_parse_rule (const char *rule)
+{
+    HevFilterTable *table;
+    const char *spec;
+
+    if (0 == strncmp (rule, "allow ", 6)) {
+        table = allow;
+        spec = rule + 6;
+    } else if (0 == strncmp (rule, "deny ", 5)) {
+        table = deny;
+        spec = rule + 5;
+    } else {
+        return -1;
+    }
+
+    while (*spec == ' ')
+        spec++;
+
+    return filter_table_add (table, spec);
+}
+
+int
+hev_filter_init (void)
+{
+    int count;
+    int i;
+
+    count = hev_config_get_filter_count ();
+    if (!count)
+        return 0;
+
+    LOG_D ("filter init");
+
+    allow = filter_table_new (count);
+    deny = filter_table_new (count);
+    if (!allow || !deny) {
+        LOG_E ("filter table");
+        hev_filter_fini ();
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        const char *rule = hev_config_get_filter_rule (i);
+
+        if (filter_parse_rule (rule) < 0)
+            LOG_W ("filter rule %s", rule);
+    }
+
+    return 0;
+}
+
+void
+hev_filter_fini (void)
+{
+    if (!allow && !deny)
+        return;
+
+    LOG_D ("filter fini");
+
+    filter_table_destroy (allow);
+    filter_table_destroy (deny);
+    allow = NULL;
+    deny = NULL;
+}
+
+/*
+ * Rebuild the tables after a config reload; safe because verdicts only
+ * run on the main task thread and this never yields.
+ */
+int
+hev_filter_reload (void)
+{
+    hev_filter_fini ();
+
+    return hev_filter_init ();
+}
+
+static int
+filter_table_match (HevFilterTable *table, const uint8_t *addr, uint8_t family,
+                    uint16_t dport)
+{
+    if (table->ports[dport >> 3] & (1 << (dport & 7)))
+        return 1;
+
+    if (family == 6)
+        return hev_trie_match (table->trie6, addr, 128);
+
+    return hev_trie_match (table->trie4, addr, 32);
+}
+
+int
+hev_filter_reject (const uint8_t *addr, uint8_t family, uint16_t dport)
+{
+    if (!deny)
+        return 0;
+
+    if (filter_table_match (allow, addr, family, dport))
+        return 0;
+
+    return filter_table_match (deny, addr, family, dport);
+}
@@ -0,0 +1,29 @@
+/*
+ ============================================================================
+ Name        : hev-filter.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Packet Filter
+ ============================================================================
+ */
+
+#ifndef __HEV_FILTER_H__
+#define __HEV_FILTER_H__
+
+#include <stdint.h>
+
+int hev_filter_init (void);
+void hev_filter_fini (void);
+int hev_filter_reload (void);
+
+/*
+ * Verdict for a new flow before any session state is allocated; addr
+ * is the wire-order destination bytes, family the lwip address type
+ * (0 = v4, 6 = v6). Returns 1 when the flow is denied: a port bitmap
+ * probe plus prefix trie probes, no allocations, callable from the
+ * lwip accept callbacks. Explicit allow rules win over deny rules;
+ * everything not matched is allowed.
+ */
+int hev_filter_reject (const uint8_t *addr, uint8_t family, uint16_t dport);
+
+#endif /* __HEV_FILTER_H__ */
@@ -17,6 +17,8 @@
 #include <string.h>
 
 #include "hev-main.h"
+#include "hev-stats.h"
+#include "hev-socks5-tunnel.h"
 
 #include "hev-jni.h"
 
@@ -37,11 +39,18 @@ static pthread_key_t current_jni_env;
 static void native_start_service (JNIEnv *env, jobject thiz, jstring conig_path,
                                   jint port);
 static void native_stop_service (JNIEnv *env, jobject thiz);
+static jobject native_get_stats_buffer (JNIEnv *env, jobject thiz);
+static void native_set_background_state (JNIEnv *env, jobject thiz,
+                                         jboolean background);
 
 static JNINativeMethod native_methods[] = {
     { "TProxyStartService", "(Ljava/lang/String;I)V",
       (void *)native_start_service },
     { "TProxyStopService", "()V", (void *)native_stop_service },
+    { "TProxyGetStatsBuffer", "()Ljava/nio/ByteBuffer;",
+      (void *)native_get_stats_buffer },
+    { "TProxySetBackgroundState", "(Z)V",
+      (void *)native_set_background_state },
 };
 
 static void
@@ -115,4 +124,24 @@ native_stop_service (JNIEnv *env, jobject thiz)
     pthread_join (work_thread, NULL);
     work_thread = 0;
 }
+
+/*
+ * The counters are a static block of 64-bit atomics updated in place
+ * by the tunnel; wrapping them in a direct ByteBuffer lets the app
+ * sample bytes, packets and the session count with plain getLong()
+ * reads, no JNI transition per sample. Layout follows the field order
+ * of HevStatsCounters.
+ */
+static jobject
+native_get_stats_buffer (JNIEnv *env, jobject thiz)
+{
+    return (*env)->NewDirectByteBuffer (env, &hev_stats_counters,
+                                        sizeof (hev_stats_counters));
+}
+
+static void
+native_set_background_state (JNIEnv *env, jobject thiz, jboolean background)
+{
+    hev_socks5_tunnel_set_background (background ? 1 : 0);
+}
 #endif
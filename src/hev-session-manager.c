@@ -0,0 +1,204 @@
+/*
+ ============================================================================
+ Name        : hev-session-manager.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Session Manager
+ ============================================================================
+ */
+
+#include <lwip/ip.h>
+
+#include <hev-task.h>
+
+#include "hev-config.h"
+#include "hev-logger.h"
+#include "hev-stats.h"
+
+#include "hev-socks5-session.h"
+#include "hev-socks5-tunnel.h"
+
+#include "hev-session-manager.h"
+
+#define SESSION_REAPER_INTERVAL (5000)
+#define SESSION_IDLE_UDP (30000)
+#define SESSION_IDLE_UDP_ONESHOT (5000)
+#define SESSION_SHED_BATCH (64)
+
+static HevTask *task_reaper;
+static int reaper_run;
+
+/*
+ * Idleness is observed, not recorded: the reaper compares the session
+ * packet counters against the last pass instead of having the splice
+ * loops stamp a timestamp per packet. The hot paths stay untouched and
+ * idle_mark/idle_ticks have a single writer under the session mutex.
+ */
+static void
+session_age (HevSocks5Session *s, void *data)
+{
+    unsigned int timeout;
+    uint64_t total;
+
+    total = HEV_SESSION_STATS_GET (s, tx_packets) +
+            HEV_SESSION_STATS_GET (s, rx_packets);
+    if (total != s->idle_mark) {
+        s->idle_mark = total;
+        s->idle_ticks = 0;
+        return;
+    }
+
+    if (s->idle_ticks < UINT16_MAX)
+        s->idle_ticks++;
+
+    /*
+     * TCP idleness is already bounded by read-write-timeout; the reaper
+     * only tightens UDP, where one-shot exchanges (a DNS query and its
+     * reply) would otherwise pin a stack and a pcb for a full minute.
+     */
+    if (s->key.proto != IP_PROTO_UDP)
+        return;
+
+    if ((total > 0) && (total <= 3))
+        timeout = SESSION_IDLE_UDP_ONESHOT;
+    else
+        timeout = SESSION_IDLE_UDP;
+
+    if ((unsigned int)s->idle_ticks * SESSION_REAPER_INTERVAL >= timeout) {
+        HEV_STATS_ADD (session_evicts, 1);
+        hev_socks5_session_terminate (s);
+    }
+}
+
+static void
+reaper_task_entry (void *data)
+{
+    LOG_D ("session manager reaper run");
+
+    for (; reaper_run;) {
+        hev_task_sleep (SESSION_REAPER_INTERVAL);
+        if (!reaper_run)
+            break;
+
+        hev_socks5_tunnel_foreach_session (session_age, NULL);
+    }
+}
+
+int
+hev_session_manager_init (void)
+{
+    LOG_D ("session manager init");
+
+    task_reaper = hev_task_new (-1);
+    if (!task_reaper) {
+        LOG_E ("session manager reaper");
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+hev_session_manager_fini (void)
+{
+    if (!task_reaper)
+        return;
+
+    LOG_D ("session manager fini");
+
+    hev_task_unref (task_reaper);
+    task_reaper = NULL;
+}
+
+void
+hev_session_manager_run (void)
+{
+    if (!task_reaper)
+        return;
+
+    reaper_run = 1;
+    task_reaper = hev_task_ref (task_reaper);
+    hev_task_run (task_reaper, reaper_task_entry, NULL);
+}
+
+void
+hev_session_manager_stop (void)
+{
+    if (!reaper_run)
+        return;
+
+    reaper_run = 0;
+    hev_task_wakeup (task_reaper);
+}
+
+static void
+session_oldest_idle (HevSocks5Session *s, void *data)
+{
+    HevSocks5Session **oldest = data;
+
+    if (!s->idle_ticks)
+        return;
+
+    if (!*oldest || (s->idle_ticks > (*oldest)->idle_ticks))
+        *oldest = s;
+}
+
+/*
+ * Called from the lwip accept callbacks, which already run under the
+ * session mutex; the scan must use the locked foreach variant or it
+ * would relock the same non-recursive mutex and deadlock.
+ */
+int
+hev_session_manager_admit (void)
+{
+    HevSocks5Session *oldest = NULL;
+    unsigned int limit;
+
+    limit = hev_config_get_misc_session_limit ();
+    if (!limit)
+        return 0;
+
+    if (hev_socks5_tunnel_session_count () < limit)
+        return 0;
+
+    hev_socks5_tunnel_foreach_session_locked (session_oldest_idle, &oldest);
+    if (!oldest)
+        return -1;
+
+    /*
+     * Soft cap: the evicted session needs a scheduler pass to unwind,
+     * so the table briefly overshoots by one while it drains.
+     */
+    HEV_STATS_ADD (session_evicts, 1);
+    hev_socks5_session_terminate (oldest);
+
+    return 0;
+}
+
+static void
+session_shed_idle (HevSocks5Session *s, void *data)
+{
+    unsigned int *budget = data;
+
+    if (!*budget || !s->idle_ticks)
+        return;
+
+    (*budget)--;
+    HEV_STATS_ADD (session_evicts, 1);
+    hev_socks5_session_terminate (s);
+}
+
+void
+hev_session_manager_shed (void)
+{
+    unsigned int budget = SESSION_SHED_BATCH;
+
+    if (!reaper_run)
+        return;
+
+    hev_socks5_tunnel_foreach_session (session_shed_idle, &budget);
+
+    if (budget < SESSION_SHED_BATCH)
+        LOG_W ("session manager shed %u idle sessions",
+               SESSION_SHED_BATCH - budget);
+}
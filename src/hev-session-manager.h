@@ -0,0 +1,32 @@
+/*
+ ============================================================================
+ Name        : hev-session-manager.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Session Manager
+ ============================================================================
+ */
+
+#ifndef __HEV_SESSION_MANAGER_H__
+#define __HEV_SESSION_MANAGER_H__
+
+int hev_session_manager_init (void);
+void hev_session_manager_fini (void);
+
+void hev_session_manager_run (void);
+void hev_session_manager_stop (void);
+
+/*
+ * Cap check for a new session; evicts the longest-idle session to make
+ * room when misc.session-limit is reached. Returns -1 when the table is
+ * full of active sessions and the accept should be dropped.
+ */
+int hev_session_manager_admit (void);
+
+/*
+ * Memory pressure: terminate a batch of idle sessions immediately so
+ * their stacks, pcbs and frame lists return to the allocator.
+ */
+void hev_session_manager_shed (void);
+
+#endif /* __HEV_SESSION_MANAGER_H__ */
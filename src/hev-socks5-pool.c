@@ -0,0 +1,242 @@
+/*
+ ============================================================================
+ Name        : hev-socks5-pool.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Socks5 Pool
+ ============================================================================
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include <hev-task.h>
+#include <hev-task-io.h>
+#include <hev-task-io-socket.h>
+
+#include "hev-mutex.h"
+#include "hev-config.h"
+#include "hev-logger.h"
+
+#include "hev-socks5-pool.h"
+
+static struct sockaddr_storage pool_addr;
+static socklen_t pool_addr_len;
+
+static int pool_fds[HEV_SOCKS5_POOL_SIZE_MAX];
+static int pool_count;
+static int pool_size;
+static int pool_running;
+
+static HevMutex mutex;
+static HevTask *task_pool;
+
+static int
+pool_task_io_yielder (HevTaskYieldType type, void *data)
+{
+    hev_task_yield (type);
+
+    return pool_running ? 0 : -1;
+}
+
+static int
+pool_connect (void)
+{
+    int one = 1;
+    int res;
+    int fd;
+
+    fd = hev_task_io_socket_socket (pool_addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    res = hev_task_add_fd (hev_task_self (), fd, POLLIN | POLLOUT);
+    if (res < 0) {
+        close (fd);
+        return -1;
+    }
+
+    res = hev_task_io_socket_connect (fd, (struct sockaddr *)&pool_addr,
+                                      pool_addr_len, pool_task_io_yielder,
+                                      NULL);
+    if (res < 0) {
+        close (fd);
+        return -1;
+    }
+
+    /* parked fds are watched with plain poll; the acquiring session
+     * registers the fd with its own task */
+    hev_task_del_fd (hev_task_self (), fd);
+
+    setsockopt (fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof (one));
+
+    return fd;
+}
+
+/*
+ * An idle pre-negotiation connection never has pending input; anything
+ * readable (or a hangup) means the server gave up on it.
+ */
+static void
+pool_check (void)
+{
+    int i;
+
+    hev_mutex_lock (&mutex);
+    for (i = 0; i < pool_count;) {
+        struct pollfd pfd = { .fd = pool_fds[i], .events = POLLIN };
+
+        if (poll (&pfd, 1, 0) > 0) {
+            close (pool_fds[i]);
+            pool_fds[i] = pool_fds[--pool_count];
+            continue;
+        }
+        i++;
+    }
+    hev_mutex_unlock (&mutex);
+}
+
+static void
+pool_task_entry (void *data)
+{
+    LOG_D ("socks5 pool task run");
+
+    while (pool_running) {
+        for (;;) {
+            int fd;
+
+            hev_mutex_lock (&mutex);
+            fd = (pool_count < pool_size) ? 0 : -1;
+            hev_mutex_unlock (&mutex);
+            if (fd < 0)
+                break;
+
+            fd = pool_connect ();
+            if (fd < 0)
+                break;
+
+            hev_mutex_lock (&mutex);
+            if (pool_count < pool_size) {
+                pool_fds[pool_count++] = fd;
+                fd = -1;
+            }
+            hev_mutex_unlock (&mutex);
+            if (fd >= 0)
+                close (fd);
+        }
+
+        hev_task_sleep (1000);
+        if (pool_running)
+            pool_check ();
+    }
+}
+
+int
+hev_socks5_pool_init (void)
+{
+    struct addrinfo hints = { 0 };
+    struct addrinfo *result;
+    char port[8];
+    const char *addr;
+    int res;
+
+    pool_size = hev_config_get_misc_socks5_pool ();
+    if (!pool_size)
+        return 0;
+
+    LOG_D ("socks5 pool init");
+
+    addr = hev_config_get_socks5_address (&res);
+    snprintf (port, sizeof (port), "%d", res);
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    res = getaddrinfo (addr, port, &hints, &result);
+    if (res < 0) {
+        LOG_E ("socks5 pool resolve");
+        goto exit;
+    }
+
+    memcpy (&pool_addr, result->ai_addr, result->ai_addrlen);
+    pool_addr_len = result->ai_addrlen;
+    freeaddrinfo (result);
+
+    if (hev_mutex_init (&mutex, hev_config_get_misc_workers () > 1) < 0) {
+        LOG_E ("socks5 pool mutex");
+        goto exit;
+    }
+
+    task_pool = hev_task_new (-1);
+    if (!task_pool) {
+        LOG_E ("socks5 pool task");
+        goto exit;
+    }
+
+    return 0;
+
+exit:
+    pool_size = 0;
+    return -1;
+}
+
+void
+hev_socks5_pool_fini (void)
+{
+    int i;
+
+    if (!pool_size)
+        return;
+
+    LOG_D ("socks5 pool fini");
+
+    hev_task_unref (task_pool);
+    task_pool = NULL;
+
+    for (i = 0; i < pool_count; i++)
+        close (pool_fds[i]);
+    pool_count = 0;
+}
+
+void
+hev_socks5_pool_run (void)
+{
+    if (!pool_size)
+        return;
+
+    pool_running = 1;
+    task_pool = hev_task_ref (task_pool);
+    hev_task_run (task_pool, pool_task_entry, NULL);
+}
+
+void
+hev_socks5_pool_stop (void)
+{
+    if (!pool_running)
+        return;
+
+    pool_running = 0;
+    hev_task_wakeup (task_pool);
+}
+
+int
+hev_socks5_pool_acquire (void)
+{
+    int fd = -1;
+
+    if (!pool_size)
+        return -1;
+
+    hev_mutex_lock (&mutex);
+    if (pool_count > 0)
+        fd = pool_fds[--pool_count];
+    hev_mutex_unlock (&mutex);
+
+    if ((fd >= 0) && task_pool)
+        hev_task_wakeup (task_pool);
+
+    return fd;
+}
@@ -0,0 +1,23 @@
+/*
+ ============================================================================
+ Name        : hev-socks5-pool.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Socks5 Pool
+ ============================================================================
+ */
+
+#ifndef __HEV_SOCKS5_POOL_H__
+#define __HEV_SOCKS5_POOL_H__
+
+#define HEV_SOCKS5_POOL_SIZE_MAX (64)
+
+int hev_socks5_pool_init (void);
+void hev_socks5_pool_fini (void);
+
+void hev_socks5_pool_run (void);
+void hev_socks5_pool_stop (void);
+
+int hev_socks5_pool_acquire (void);
+
+#endif /* __HEV_SOCKS5_POOL_H__ */
@@ -15,18 +15,69 @@
 #include <hev-task.h>
 #include <hev-task-io.h>
 #include <hev-task-io-socket.h>
-#include <hev-task-mutex.h>
+#include "hev-mutex.h"
 #include <hev-memory-allocator.h>
 #include <hev-socks5-misc.h>
 #include <hev-socks5-client-tcp.h>
 
 #include "hev-logger.h"
+#include "hev-config.h"
+#include "hev-compiler.h"
+#include "hev-pbuf-pool.h"
+#include "hev-buffer-arena.h"
 #include "hev-config-const.h"
 
 #include "hev-socks5-session-tcp.h"
 
 #define task_io_yielder hev_socks5_task_io_yielder
 
+typedef struct _HevSocks5TCPSndBuf HevSocks5TCPSndBuf;
+
+struct _HevSocks5TCPSndBuf
+{
+    HevListNode node;
+    struct pbuf *data;
+};
+
+static void
+tcp_sndq_drain (HevSocks5SessionTCP *self)
+{
+    HevListNode *node;
+
+    node = hev_list_first (&self->sndq);
+    while (node) {
+        HevSocks5TCPSndBuf *sbuf;
+
+        sbuf = container_of (node, HevSocks5TCPSndBuf, node);
+        if (self->sndq_acked < sbuf->data->tot_len)
+            break;
+
+        self->sndq_acked -= sbuf->data->tot_len;
+        node = hev_list_node_next (node);
+        hev_list_del (&self->sndq, &sbuf->node);
+        pbuf_free (sbuf->data);
+        hev_free (sbuf);
+    }
+
+    if (!hev_list_first (&self->sndq))
+        self->sndq_acked = 0;
+}
+
+static size_t
+tcp_splice_budget_clamp (HevSocks5SessionTCP *self, size_t size)
+{
+    unsigned int budget;
+
+    if (self->base.priority < HEV_TASK_PRIORITY_DEFAULT)
+        return size;
+
+    budget = hev_config_get_misc_tcp_splice_budget ();
+    if (budget && (size > budget))
+        return budget;
+
+    return size;
+}
+
 static int
 tcp_splice_f (HevSocks5SessionTCP *self)
 {
@@ -41,12 +92,24 @@ tcp_splice_f (HevSocks5SessionTCP *self)
     if (self->queue->next) {
         struct pbuf *p = self->queue;
         struct iovec iov[64];
+        unsigned int budget;
+        unsigned int total;
         int i;
 
+        /* bulk sessions hand the cpu back after a quantum so queued
+         * interactive flows are not stuck behind a fat splice pass */
+        budget = hev_config_get_misc_tcp_splice_budget ();
+        if (self->base.priority < HEV_TASK_PRIORITY_DEFAULT)
+            budget = 0;
+
+        total = 0;
         for (i = 0; (i < 64) && p; p = p->next) {
             iov[i].iov_base = p->payload;
             iov[i].iov_len = p->len;
+            total += p->len;
             i++;
+            if (budget && (total >= budget))
+                break;
         }
 
         s = writev (fd, iov, i);
@@ -59,17 +122,54 @@ tcp_splice_f (HevSocks5SessionTCP *self)
             return 0;
         return -1;
     } else {
-        hev_task_mutex_lock (self->mutex);
+        hev_mutex_lock (self->mutex);
         self->queue = pbuf_free_header (self->queue, s);
-        tcp_recved (self->pcb, s);
-        hev_task_mutex_unlock (self->mutex);
+        self->recved_pending += s;
+        /* batch window updates; an lwip ACK per writev is too chatty */
+        if (!self->queue ||
+            (self->recved_pending >= self->recv_window / 4)) {
+            while (self->recved_pending) {
+                u16_t n = 0xffff;
+
+                if (n > self->recved_pending)
+                    n = self->recved_pending;
+                tcp_recved (self->pcb, n);
+                self->recved_pending -= n;
+            }
+        }
+        hev_mutex_unlock (self->mutex);
+        HEV_SESSION_STATS_ADD (self, tx_packets, 1);
+        HEV_SESSION_STATS_ADD (self, tx_bytes, s);
     }
 
     return 1;
 }
 
+/*
+ * Grow the read window after a full read: a flow that keeps the
+ * buffer full is a long fat one, while idle sessions stay at the
+ * initial small window. The cap is the arena block size fixed at
+ * startup, not the config value: a reload can raise the config cap
+ * but cannot grow blocks already handed out.
+ */
+static void
+tcp_buffer_grow (HevSocks5SessionTCP *self)
+{
+    const unsigned int max = hev_buffer_arena_get_step ();
+    unsigned int size;
+
+    if (self->buffer_size >= max)
+        return;
+
+    size = self->buffer_size * 2;
+    if (size > max)
+        size = max;
+
+    self->buffer_size = size;
+}
+
 static int
-tcp_splice_b (HevSocks5SessionTCP *self, uint8_t *buffer)
+tcp_splice_b (HevSocks5SessionTCP *self)
 {
     u8_t flags = TCP_WRITE_FLAG_COPY;
     err_t err = ERR_OK;
@@ -81,21 +181,22 @@ tcp_splice_b (HevSocks5SessionTCP *self, uint8_t *buffer)
         return -1;
 
     if (!(size = tcp_sndbuf (self->pcb))) {
-        hev_task_mutex_lock (self->mutex);
+        hev_mutex_lock (self->mutex);
         if (self->pcb)
             err = tcp_output (self->pcb);
-        hev_task_mutex_unlock (self->mutex);
+        hev_mutex_unlock (self->mutex);
         if (!self->pcb || (err != ERR_OK))
             return -1;
         return 0;
     }
 
-    if (size > TCP_BUF_SIZE)
-        size = TCP_BUF_SIZE;
+    if (size > self->buffer_size)
+        size = self->buffer_size;
+    size = tcp_splice_budget_clamp (self, size);
 
     fd = HEV_SOCKS5 (self->base.client)->fd;
 
-    s = read (fd, buffer, size);
+    s = read (fd, self->buffer, size);
     if (0 >= s) {
         if ((0 > s) && (EAGAIN == errno))
             return 0;
@@ -104,13 +205,97 @@ tcp_splice_b (HevSocks5SessionTCP *self, uint8_t *buffer)
         flags |= TCP_WRITE_FLAG_MORE;
     }
 
-    hev_task_mutex_lock (self->mutex);
+    hev_mutex_lock (self->mutex);
     if (self->pcb)
-        err = tcp_write (self->pcb, buffer, s, flags);
-    hev_task_mutex_unlock (self->mutex);
+        err = tcp_write (self->pcb, self->buffer, s, flags);
+    hev_mutex_unlock (self->mutex);
     if (!self->pcb || (err != ERR_OK))
         return -1;
 
+    HEV_SESSION_STATS_ADD (self, rx_packets, 1);
+    HEV_SESSION_STATS_ADD (self, rx_bytes, s);
+
+    if (s == size)
+        tcp_buffer_grow (self);
+
+    return 1;
+}
+
+static int
+tcp_splice_b_zc (HevSocks5SessionTCP *self)
+{
+    HevSocks5TCPSndBuf *sbuf;
+    err_t err = ERR_OK;
+    struct pbuf *buf;
+    u8_t flags = 0;
+    size_t size;
+    ssize_t s;
+    int fd;
+
+    if (!self->pcb)
+        return -1;
+
+    if (!(size = tcp_sndbuf (self->pcb))) {
+        hev_mutex_lock (self->mutex);
+        if (self->pcb)
+            err = tcp_output (self->pcb);
+        hev_mutex_unlock (self->mutex);
+        if (!self->pcb || (err != ERR_OK))
+            return -1;
+        return 0;
+    }
+
+    if (size > self->buffer_size)
+        size = self->buffer_size;
+    size = tcp_splice_budget_clamp (self, size);
+
+    fd = HEV_SOCKS5 (self->base.client)->fd;
+
+    hev_mutex_lock (self->mutex);
+    buf = hev_pbuf_pool_alloc (PBUF_RAW, size);
+    hev_mutex_unlock (self->mutex);
+    if (!buf)
+        return -1;
+
+    s = read (fd, buf->payload, size);
+    if (0 >= s) {
+        pbuf_free (buf);
+        if ((0 > s) && (EAGAIN == errno))
+            return 0;
+        return -1;
+    } else if (s == size) {
+        flags |= TCP_WRITE_FLAG_MORE;
+    }
+
+    sbuf = hev_malloc0 (sizeof (HevSocks5TCPSndBuf));
+    if (!sbuf) {
+        pbuf_free (buf);
+        return -1;
+    }
+
+    buf->len = s;
+    buf->tot_len = s;
+    sbuf->data = buf;
+
+    hev_mutex_lock (self->mutex);
+    if (self->pcb) {
+        err = tcp_write (self->pcb, buf->payload, s, flags);
+        if (err == ERR_OK)
+            hev_list_add_tail (&self->sndq, &sbuf->node);
+    }
+    hev_mutex_unlock (self->mutex);
+    if (!self->pcb || (err != ERR_OK)) {
+        pbuf_free (buf);
+        hev_free (sbuf);
+        return -1;
+    }
+
+    HEV_SESSION_STATS_ADD (self, rx_packets, 1);
+    HEV_SESSION_STATS_ADD (self, rx_bytes, s);
+
+    if (s == size)
+        tcp_buffer_grow (self);
+
     return 1;
 }
 
@@ -118,23 +303,32 @@ static void
 hev_socks5_session_tcp_splice (HevSocks5Session *base)
 {
     HevSocks5SessionTCP *self = HEV_SOCKS5_SESSION_TCP (base);
-    uint8_t *buffer;
+    int zero_copy;
     int res_f = 1;
     int res_b = 1;
 
     LOG_D ("%p socks5 session tcp splice", self);
 
-    buffer = hev_malloc (TCP_BUF_SIZE);
-    if (!buffer)
-        return;
+    zero_copy = hev_config_get_misc_tcp_zero_copy ();
 
     for (;;) {
         HevTaskYieldType type;
 
+        if (!zero_copy && !self->buffer) {
+            /* lease only while actively moving data */
+            self->buffer = hev_buffer_arena_alloc ();
+            if (!self->buffer)
+                break;
+        }
+
         if (res_f >= 0)
             res_f = tcp_splice_f (self);
-        if (res_b >= 0)
-            res_b = tcp_splice_b (self, buffer);
+        if (res_b >= 0) {
+            if (zero_copy)
+                res_b = tcp_splice_b_zc (self);
+            else
+                res_b = tcp_splice_b (self);
+        }
 
         if (res_f < 0 && res_b < 0)
             break;
@@ -143,11 +337,19 @@ hev_socks5_session_tcp_splice (HevSocks5Session *base)
         else
             type = HEV_TASK_WAITIO;
 
+        if (type == HEV_TASK_WAITIO && self->buffer) {
+            hev_buffer_arena_free (self->buffer);
+            self->buffer = NULL;
+        }
+
         if (task_io_yielder (type, base->client) < 0)
             break;
     }
 
-    hev_free (buffer);
+    if (self->buffer) {
+        hev_buffer_arena_free (self->buffer);
+        self->buffer = NULL;
+    }
 }
 
 static HevSocks5SessionTCPClass _klass = {
@@ -181,19 +383,30 @@ hev_socks5_session_tcp_destruct (HevSocks5Session *base)
 
     LOG_D ("%p socks5 session tcp destruct", self);
 
-    hev_task_mutex_lock (self->mutex);
+    hev_mutex_lock (self->mutex);
     if (self->pcb) {
         tcp_recv (self->pcb, NULL);
         tcp_sent (self->pcb, NULL);
         tcp_err (self->pcb, NULL);
 
-        if (tcp_close (self->pcb) != ERR_OK)
+        /*
+         * Zero-copy segments reference the sndq pbufs: a graceful
+         * close keeps the pcb alive to retransmit them after the
+         * payloads are freed below. Abort while unacked data remains
+         * so the stack drops its references first.
+         */
+        if (hev_list_first (&self->sndq))
+            tcp_abort (self->pcb);
+        else if (tcp_close (self->pcb) != ERR_OK)
             tcp_abort (self->pcb);
     }
 
     if (self->queue)
         pbuf_free (self->queue);
-    hev_task_mutex_unlock (self->mutex);
+
+    self->sndq_acked = (unsigned int)-1;
+    tcp_sndq_drain (self);
+    hev_mutex_unlock (self->mutex);
 
     hev_socks5_session_destruct (base);
 }
@@ -212,21 +425,25 @@ tcp_recv_handler (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
     if (!self->queue) {
         self->queue = p;
     } else {
-        if (self->queue->tot_len > TCP_WND)
+        if (self->queue->tot_len > self->recv_window)
             return ERR_WOULDBLOCK;
         pbuf_cat (self->queue, p);
     }
 
-    hev_task_wakeup (s->task);
+    hev_socks5_session_wakeup (s);
     return ERR_OK;
 }
 
 static err_t
 tcp_sent_handler (void *arg, struct tcp_pcb *pcb, u16_t len)
 {
+    HevSocks5SessionTCP *self = arg;
     HevSocks5Session *s = arg;
 
-    hev_task_wakeup (s->task);
+    self->sndq_acked += len;
+    tcp_sndq_drain (self);
+
+    hev_socks5_session_wakeup (s);
 
     return ERR_OK;
 }
@@ -242,7 +459,7 @@ tcp_err_handler (void *arg, err_t err)
 }
 
 HevSocks5SessionTCP *
-hev_socks5_session_tcp_new (struct tcp_pcb *pcb, HevTaskMutex *mutex)
+hev_socks5_session_tcp_new (struct tcp_pcb *pcb, HevMutex *mutex)
 {
     HevSocks5SessionTCP *self;
     HevSocks5ClientTCP *tcp;
@@ -294,6 +511,10 @@ hev_socks5_session_tcp_new (struct tcp_pcb *pcb, HevTaskMutex *mutex)
 
     self->pcb = pcb;
     self->mutex = mutex;
+    self->buffer_size = 2048;
+    self->recv_window = hev_config_get_misc_tcp_recv_window ();
+    if (!self->recv_window)
+        self->recv_window = TCP_WND;
     self->base.client = HEV_SOCKS5_CLIENT (tcp);
 
     return self;
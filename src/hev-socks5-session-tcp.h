@@ -10,6 +10,7 @@
 #ifndef __HEV_SOCKS5_SESSION_TCP_H__
 #define __HEV_SOCKS5_SESSION_TCP_H__
 
+#include "hev-mutex.h"
 #include "hev-socks5-session.h"
 
 #define HEV_SOCKS5_SESSION_TCP(p) ((HevSocks5SessionTCP *)p)
@@ -24,7 +25,15 @@ struct _HevSocks5SessionTCP
 
     struct pbuf *queue;
     struct tcp_pcb *pcb;
-    HevTaskMutex *mutex;
+    HevMutex *mutex;
+
+    HevList sndq;
+    unsigned int sndq_acked;
+
+    uint8_t *buffer;
+    unsigned int buffer_size;
+    unsigned int recv_window;
+    unsigned int recved_pending;
 };
 
 struct _HevSocks5SessionTCPClass
@@ -36,6 +45,6 @@ int hev_socks5_session_tcp_construct (HevSocks5SessionTCP *self);
 void hev_socks5_session_tcp_destruct (HevSocks5Session *base);
 
 HevSocks5SessionTCP *hev_socks5_session_tcp_new (struct tcp_pcb *pcb,
-                                                 HevTaskMutex *mutex);
+                                                 HevMutex *mutex);
 
 #endif /* __HEV_SOCKS5_SESSION_TCP_H__ */
@@ -7,30 +7,42 @@
  ============================================================================
  */
 
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <string.h>
 
 #include <lwip/udp.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
 
 #include <hev-task.h>
 #include <hev-task-io.h>
 #include <hev-task-io-socket.h>
-#include <hev-task-mutex.h>
+#include "hev-mutex.h"
 #include <hev-memory-allocator.h>
 #include <hev-socks5-udp.h>
 #include <hev-socks5-misc.h>
 #include <hev-socks5-client-udp.h>
 
 #include "hev-logger.h"
+#include "hev-config.h"
 #include "hev-compiler.h"
+#include "hev-pbuf-pool.h"
 #include "hev-config-const.h"
 
 #include "hev-socks5-session-udp.h"
 
 #define task_io_yielder hev_socks5_task_io_yielder
 
+#define UDP_FRAME_CHUNK (64)
+#define UDP_MMSG_MAX (32)
+#define UDP_HDR_MAX (22)
+#define UDP_IOV_MAX (4)
+#define UDP_IOV_SPILL_MAX (64)
+
 typedef struct _HevSocks5UDPFrame HevSocks5UDPFrame;
+typedef struct _HevSocks5UDPFrameChunk HevSocks5UDPFrameChunk;
 
 struct _HevSocks5UDPFrame
 {
@@ -39,39 +51,431 @@ struct _HevSocks5UDPFrame
     struct pbuf *data;
 };
 
-static int
-hev_socks5_session_udp_fwd_f (HevSocks5SessionUDP *self)
+struct _HevSocks5UDPFrameChunk
+{
+    HevListNode node;
+    HevSocks5UDPFrame frames[UDP_FRAME_CHUNK];
+};
+
+/*
+ * The frame lists are shared between the lwip thread (the recv hook
+ * appends under the session mutex) and the session task (the fwd path
+ * consumes); every mutation below must hold self->mutex.
+ */
+static HevSocks5UDPFrame *
+hev_socks5_session_udp_frame_alloc (HevSocks5SessionUDP *self)
 {
     HevSocks5UDPFrame *frame;
-    struct sockaddr *addr;
     HevListNode *node;
-    HevSocks5UDP *udp;
-    struct pbuf *buf;
+
+    node = hev_list_first (&self->frame_free);
+    if (!node) {
+        HevSocks5UDPFrameChunk *chunk;
+        int i;
+
+        chunk = hev_malloc0 (sizeof (HevSocks5UDPFrameChunk));
+        if (!chunk)
+            return NULL;
+
+        hev_list_add_tail (&self->frame_chunks, &chunk->node);
+        for (i = 0; i < UDP_FRAME_CHUNK; i++)
+            hev_list_add_tail (&self->frame_free, &chunk->frames[i].node);
+        node = hev_list_first (&self->frame_free);
+    }
+
+    frame = container_of (node, HevSocks5UDPFrame, node);
+    hev_list_del (&self->frame_free, node);
+    memset (&frame->node, 0, sizeof (frame->node));
+
+    return frame;
+}
+
+static void
+hev_socks5_session_udp_frame_free (HevSocks5SessionUDP *self,
+                                   HevSocks5UDPFrame *frame)
+{
+    memset (&frame->node, 0, sizeof (frame->node));
+    hev_list_add_tail (&self->frame_free, &frame->node);
+}
+
+/* RFC 1928 UDP request header: RSV(2) FRAG(1) ATYP(1) ADDR PORT(2) */
+static int
+socks5_udp_hdr_build (uint8_t *hdr, const struct sockaddr *addr)
+{
+    memset (hdr, 0, 4);
+
+    if (addr->sa_family == AF_INET) {
+        struct sockaddr_in *adp = (struct sockaddr_in *)addr;
+
+        hdr[3] = 0x01;
+        memcpy (hdr + 4, &adp->sin_addr, 4);
+        memcpy (hdr + 8, &adp->sin_port, 2);
+        return 10;
+    } else if (addr->sa_family == AF_INET6) {
+        struct sockaddr_in6 *adp = (struct sockaddr_in6 *)addr;
+
+        hdr[3] = 0x04;
+        memcpy (hdr + 4, &adp->sin6_addr, 16);
+        memcpy (hdr + 20, &adp->sin6_port, 2);
+        return 22;
+    }
+
+    return -1;
+}
+
+static int
+socks5_udp_hdr_parse (const uint8_t *hdr, int len, ip_addr_t *addr,
+                      uint16_t *port)
+{
+    if ((len < 10) || hdr[2])
+        return -1;
+
+    switch (hdr[3]) {
+    case 0x01:
+        memcpy (addr, hdr + 4, 4);
+        addr->type = IPADDR_TYPE_V4;
+        *port = (hdr[8] << 8) | hdr[9];
+        return 10;
+    case 0x04:
+        if (len < 22)
+            return -1;
+        memcpy (addr, hdr + 4, 16);
+        addr->type = IPADDR_TYPE_V6;
+        *port = (hdr[20] << 8) | hdr[21];
+        return 22;
+    }
+
+    return -1;
+}
+
+static int
+udp_relay_is_dgram (int fd)
+{
+    socklen_t len = sizeof (int);
+    int type = 0;
+
+    if (getsockopt (fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+        return 0;
+
+    return type == SOCK_DGRAM;
+}
+
+/*
+ * Send one frame with a chain too long for the batched iovec slots;
+ * the frame stays queued on EAGAIN.
+ */
+static int
+hev_socks5_session_udp_fwd_f_spill (HevSocks5SessionUDP *self, int fd,
+                                    HevSocks5UDPFrame *frame)
+{
+    uint8_t hdr[UDP_HDR_MAX];
+    struct iovec iov[UDP_IOV_SPILL_MAX];
+    struct msghdr mh = { 0 };
+    struct pbuf *p;
+    ssize_t s;
+    int hlen;
+    int i = 0;
+
+    if (!self->base.bypass) {
+        hlen = socks5_udp_hdr_build (hdr, (struct sockaddr *)&frame->addr);
+        if (hlen < 0)
+            goto drop;
+
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = hlen;
+        i = 1;
+    }
+
+    for (p = frame->data; (i < UDP_IOV_SPILL_MAX) && p; p = p->next) {
+        iov[i].iov_base = p->payload;
+        iov[i].iov_len = p->len;
+        i++;
+    }
+
+    mh.msg_iov = iov;
+    mh.msg_iovlen = i;
+
+    s = sendmsg (fd, &mh, 0);
+    if (s <= 0) {
+        if ((s < 0) && (errno == EAGAIN))
+            return 0;
+        LOG_E ("%p socks5 session udp fwd f send", self);
+        return -1;
+    }
+
+    HEV_SESSION_STATS_ADD (self, tx_packets, 1);
+    HEV_SESSION_STATS_ADD (self, tx_bytes, frame->data->tot_len);
+
+drop:
+    hev_mutex_lock (self->mutex);
+    hev_list_del (&self->frame_list, &frame->node);
+    pbuf_free (frame->data);
+    hev_socks5_session_udp_frame_free (self, frame);
+    self->frames--;
+    hev_mutex_unlock (self->mutex);
+
+    return 1;
+}
+
+static int
+hev_socks5_session_udp_fwd_f_mmsg (HevSocks5SessionUDP *self, int fd)
+{
+    uint8_t hdrs[UDP_MMSG_MAX][UDP_HDR_MAX];
+    struct iovec iovs[UDP_MMSG_MAX][UDP_IOV_MAX];
+    struct mmsghdr msgs[UDP_MMSG_MAX];
+    int budget = hev_config_get_misc_udp_batch_size ();
+    HevListNode *node;
     int res;
+    int i;
+    int n;
+
+    if (budget > UDP_MMSG_MAX)
+        budget = UDP_MMSG_MAX;
 
+    hev_mutex_lock (self->mutex);
     node = hev_list_first (&self->frame_list);
-    if (!node)
-        return 0;
+    for (n = 0; (n < budget) && node;) {
+        HevSocks5UDPFrame *frame;
+        HevListNode *next;
+        struct pbuf *p;
+        int hlen;
+        int c = 0;
 
-    frame = container_of (node, HevSocks5UDPFrame, node);
-    udp = HEV_SOCKS5_UDP (self->base.client);
-    addr = (struct sockaddr *)&frame->addr;
-    buf = frame->data;
+        frame = container_of (node, HevSocks5UDPFrame, node);
+        next = hev_list_node_next (node);
+        if (!self->base.bypass) {
+            hlen = socks5_udp_hdr_build (hdrs[n],
+                                         (struct sockaddr *)&frame->addr);
+            if (hlen < 0) {
+                /* cannot happen for frames queued by the recv hook;
+                 * drop it anyway so the completion pops stay aligned
+                 * with the list head */
+                hev_list_del (&self->frame_list, &frame->node);
+                pbuf_free (frame->data);
+                hev_socks5_session_udp_frame_free (self, frame);
+                self->frames--;
+                node = next;
+                continue;
+            }
+
+            iovs[n][0].iov_base = hdrs[n];
+            iovs[n][0].iov_len = hlen;
+            c = 1;
+        }
+
+        for (p = frame->data; (c < UDP_IOV_MAX) && p; p = p->next) {
+            iovs[n][c].iov_base = p->payload;
+            iovs[n][c].iov_len = p->len;
+            c++;
+        }
+
+        /* a longer chain takes the spill path, alone or next round */
+        if (p) {
+            if (!n) {
+                hev_mutex_unlock (self->mutex);
+                return hev_socks5_session_udp_fwd_f_spill (self, fd, frame);
+            }
+            break;
+        }
+
+        memset (&msgs[n], 0, sizeof (msgs[n]));
+        msgs[n].msg_hdr.msg_iov = iovs[n];
+        msgs[n].msg_hdr.msg_iovlen = c;
+        n++;
+        node = next;
+    }
+    hev_mutex_unlock (self->mutex);
+
+    if (!n)
+        return 0;
 
-    res = hev_socks5_udp_sendto (udp, buf->payload, buf->len, addr);
+    res = sendmmsg (fd, msgs, n, 0);
     if (res <= 0) {
+        if ((res < 0) && (errno == EAGAIN))
+            return 0;
         LOG_E ("%p socks5 session udp fwd f send", self);
-        res = -1;
+        return -1;
     }
 
-    hev_list_del (&self->frame_list, node);
-    hev_free (frame);
-    pbuf_free (buf);
-    self->frames--;
+    hev_mutex_lock (self->mutex);
+    for (i = 0; i < res; i++) {
+        HevSocks5UDPFrame *frame;
+
+        node = hev_list_first (&self->frame_list);
+        frame = container_of (node, HevSocks5UDPFrame, node);
+        hev_list_del (&self->frame_list, node);
+        HEV_SESSION_STATS_ADD (self, tx_bytes, frame->data->tot_len);
+        pbuf_free (frame->data);
+        hev_socks5_session_udp_frame_free (self, frame);
+        self->frames--;
+    }
+    hev_mutex_unlock (self->mutex);
+    HEV_SESSION_STATS_ADD (self, tx_packets, res);
 
     return res;
 }
 
+static int
+hev_socks5_session_udp_fwd_b_mmsg (HevSocks5SessionUDP *self, int fd)
+{
+    struct pbuf *bufs[UDP_MMSG_MAX];
+    struct iovec iovs[UDP_MMSG_MAX];
+    struct mmsghdr msgs[UDP_MMSG_MAX];
+    int budget = hev_config_get_misc_udp_batch_size ();
+    int res;
+    int i;
+    int n;
+
+    if (budget > UDP_MMSG_MAX)
+        budget = UDP_MMSG_MAX;
+
+    hev_mutex_lock (self->mutex);
+    for (n = 0; n < budget; n++) {
+        bufs[n] = hev_pbuf_pool_alloc (PBUF_TRANSPORT, UDP_BUF_SIZE);
+        if (!bufs[n])
+            break;
+    }
+    hev_mutex_unlock (self->mutex);
+    if (!n) {
+        LOG_E ("%p socks5 session udp fwd b buf", self);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        iovs[i].iov_base = bufs[i]->payload;
+        iovs[i].iov_len = bufs[i]->len;
+
+        memset (&msgs[i], 0, sizeof (msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    res = recvmmsg (fd, msgs, n, MSG_DONTWAIT, NULL);
+    if (res <= 0) {
+        for (i = 0; i < n; i++)
+            pbuf_free (bufs[i]);
+        if ((res < 0) && (errno == EAGAIN))
+            return 0;
+        LOG_E ("%p socks5 session udp fwd b recv", self);
+        return -1;
+    }
+
+    hev_mutex_lock (self->mutex);
+    for (i = 0; i < res; i++) {
+        struct pbuf *buf = bufs[i];
+        ip_addr_t addr;
+        uint16_t port;
+        int hlen;
+
+        if (self->base.bypass) {
+            /* connected socket: replies are raw and only from the
+             * session destination */
+            hlen = 0;
+            addr = self->pcb->local_ip;
+            port = self->pcb->local_port;
+            if (!msgs[i].msg_len) {
+                pbuf_free (buf);
+                continue;
+            }
+        } else {
+            hlen = socks5_udp_hdr_parse (buf->payload, msgs[i].msg_len, &addr,
+                                         &port);
+            if ((hlen < 0) || ((int)msgs[i].msg_len <= hlen)) {
+                pbuf_free (buf);
+                continue;
+            }
+        }
+
+        buf->len = msgs[i].msg_len;
+        buf->tot_len = msgs[i].msg_len;
+        if (hlen)
+            pbuf_header (buf, -hlen);
+
+        if (udp_sendfrom (self->pcb, buf, &addr, port) != ERR_OK) {
+            pbuf_free (buf);
+            continue;
+        }
+
+        HEV_SESSION_STATS_ADD (self, rx_packets, 1);
+        HEV_SESSION_STATS_ADD (self, rx_bytes, msgs[i].msg_len - hlen);
+    }
+    hev_mutex_unlock (self->mutex);
+
+    for (i = res; i < n; i++)
+        pbuf_free (bufs[i]);
+
+    return res;
+}
+
+static int
+hev_socks5_session_udp_fwd_f (HevSocks5SessionUDP *self)
+{
+    int budget = hev_config_get_misc_udp_batch_size ();
+    HevSocks5UDP *udp;
+    int sent = 0;
+
+    udp = HEV_SOCKS5_UDP (self->base.client);
+
+    if (self->mmsg)
+        return hev_socks5_session_udp_fwd_f_mmsg (self, HEV_SOCKS5 (udp)->fd);
+
+    for (; sent < budget;) {
+        HevSocks5UDPFrame *frame;
+        struct sockaddr *addr;
+        HevListNode *node;
+        struct pbuf *buf;
+        int res;
+
+        hev_mutex_lock (self->mutex);
+        node = hev_list_first (&self->frame_list);
+        hev_mutex_unlock (self->mutex);
+        if (!node)
+            break;
+
+        frame = container_of (node, HevSocks5UDPFrame, node);
+        addr = (struct sockaddr *)&frame->addr;
+        buf = frame->data;
+
+        /* stream relays must go through the core framer, which wants a
+         * flat buffer; chained pbufs are rare enough to coalesce here */
+        if (buf->next) {
+            struct pbuf *flat;
+
+            hev_mutex_lock (self->mutex);
+            flat = hev_pbuf_pool_alloc (PBUF_RAW, buf->tot_len);
+            hev_mutex_unlock (self->mutex);
+            if (!flat) {
+                LOG_E ("%p socks5 session udp fwd f buf", self);
+                return -1;
+            }
+
+            pbuf_copy_partial (buf, flat->payload, buf->tot_len, 0);
+            pbuf_free (buf);
+            frame->data = flat;
+            buf = flat;
+        }
+
+        res = hev_socks5_udp_sendto (udp, buf->payload, buf->len, addr);
+
+        hev_mutex_lock (self->mutex);
+        hev_list_del (&self->frame_list, node);
+        hev_socks5_session_udp_frame_free (self, frame);
+        pbuf_free (buf);
+        self->frames--;
+        hev_mutex_unlock (self->mutex);
+
+        if (res <= 0) {
+            LOG_E ("%p socks5 session udp fwd f send", self);
+            return -1;
+        }
+        HEV_SESSION_STATS_ADD (self, tx_packets, 1);
+        HEV_SESSION_STATS_ADD (self, tx_bytes, res);
+        sent++;
+    }
+
+    return sent;
+}
+
 static int
 hev_socks5_session_udp_fwd_b (HevSocks5SessionUDP *self)
 {
@@ -92,6 +496,9 @@ hev_socks5_session_udp_fwd_b (HevSocks5SessionUDP *self)
         return -1;
     }
 
+    if (self->mmsg)
+        return hev_socks5_session_udp_fwd_b_mmsg (self, fd);
+
     res = recv (fd, &buf, 1, MSG_PEEK);
     if (res <= 0) {
         if ((res < 0) && (errno == EAGAIN))
@@ -110,9 +517,9 @@ hev_socks5_session_udp_fwd_b (HevSocks5SessionUDP *self)
         break;
     }
 
-    hev_task_mutex_lock (self->mutex);
-    buf = pbuf_alloc (PBUF_TRANSPORT, UDP_BUF_SIZE, PBUF_RAM);
-    hev_task_mutex_unlock (self->mutex);
+    hev_mutex_lock (self->mutex);
+    buf = hev_pbuf_pool_alloc (PBUF_TRANSPORT, UDP_BUF_SIZE);
+    hev_mutex_unlock (self->mutex);
     if (!buf) {
         LOG_E ("%p socks5 session udp fwd b buf", self);
         return -1;
@@ -148,9 +555,9 @@ hev_socks5_session_udp_fwd_b (HevSocks5SessionUDP *self)
     buf->len = res;
     buf->tot_len = res;
 
-    hev_task_mutex_lock (self->mutex);
+    hev_mutex_lock (self->mutex);
     err = udp_sendfrom (self->pcb, buf, &addr, port);
-    hev_task_mutex_unlock (self->mutex);
+    hev_mutex_unlock (self->mutex);
 
     if (err != ERR_OK) {
         LOG_E ("%p socks5 session udp fwd b send", self);
@@ -158,6 +565,9 @@ hev_socks5_session_udp_fwd_b (HevSocks5SessionUDP *self)
         return -1;
     }
 
+    HEV_SESSION_STATS_ADD (self, rx_packets, 1);
+    HEV_SESSION_STATS_ADD (self, rx_bytes, res);
+
     return 1;
 }
 
@@ -167,9 +577,13 @@ hev_socks5_session_udp_splice (HevSocks5Session *base)
     HevSocks5SessionUDP *self = HEV_SOCKS5_SESSION_UDP (base);
     int res_f = 1;
     int res_b = 1;
+    int fd;
 
     LOG_D ("%p socks5 session udp splice", self);
 
+    fd = HEV_SOCKS5 (self->base.client)->fd;
+    self->mmsg = (fd >= 0) && udp_relay_is_dgram (fd);
+
     for (;;) {
         HevTaskYieldType type;
 
@@ -222,6 +636,14 @@ hev_socks5_session_udp_destruct (HevSocks5Session *base)
 
     LOG_D ("%p socks5 session udp destruct", self);
 
+    /* the lwip thread keeps appending frames until the recv hook is
+     * detached, so detach and drain under the same lock hold */
+    hev_mutex_lock (self->mutex);
+    if (self->pcb) {
+        udp_recv (self->pcb, NULL, NULL);
+        udp_remove (self->pcb);
+    }
+
     node = hev_list_first (&self->frame_list);
     while (node) {
         HevSocks5UDPFrame *frame;
@@ -229,15 +651,17 @@ hev_socks5_session_udp_destruct (HevSocks5Session *base)
         frame = container_of (node, HevSocks5UDPFrame, node);
         node = hev_list_node_next (node);
         pbuf_free (frame->data);
-        hev_free (frame);
     }
 
-    hev_task_mutex_lock (self->mutex);
-    if (self->pcb) {
-        udp_recv (self->pcb, NULL, NULL);
-        udp_remove (self->pcb);
+    node = hev_list_first (&self->frame_chunks);
+    while (node) {
+        HevSocks5UDPFrameChunk *chunk;
+
+        chunk = container_of (node, HevSocks5UDPFrameChunk, node);
+        node = hev_list_node_next (node);
+        hev_free (chunk);
     }
-    hev_task_mutex_unlock (self->mutex);
+    hev_mutex_unlock (self->mutex);
 
     hev_socks5_session_destruct (base);
 }
@@ -260,14 +684,13 @@ udp_recv_handler (void *arg, struct udp_pcb *pcb, struct pbuf *p,
         return;
     }
 
-    frame = hev_malloc (sizeof (HevSocks5UDPFrame));
+    frame = hev_socks5_session_udp_frame_alloc (self);
     if (!frame) {
         pbuf_free (p);
         return;
     }
 
     frame->data = p;
-    memset (&frame->node, 0, sizeof (frame->node));
 
     addr = &pcb->local_ip;
     port = pcb->local_port;
@@ -290,11 +713,11 @@ udp_recv_handler (void *arg, struct udp_pcb *pcb, struct pbuf *p,
 
     self->frames++;
     hev_list_add_tail (&self->frame_list, &frame->node);
-    hev_task_wakeup (s->task);
+    hev_socks5_session_wakeup (s);
 }
 
 HevSocks5SessionUDP *
-hev_socks5_session_udp_new (struct udp_pcb *pcb, HevTaskMutex *mutex)
+hev_socks5_session_udp_new (struct udp_pcb *pcb, HevMutex *mutex)
 {
     HevSocks5SessionUDP *self = NULL;
     HevSocks5ClientUDP *udp;
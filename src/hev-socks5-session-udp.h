@@ -10,6 +10,7 @@
 #ifndef __HEV_SOCKS5_SESSION_UDP_H__
 #define __HEV_SOCKS5_SESSION_UDP_H__
 
+#include "hev-mutex.h"
 #include "hev-socks5-session.h"
 
 #define HEV_SOCKS5_SESSION_UDP(p) ((HevSocks5SessionUDP *)p)
@@ -23,9 +24,12 @@ struct _HevSocks5SessionUDP
     HevSocks5Session base;
 
     HevList frame_list;
+    HevList frame_free;
+    HevList frame_chunks;
     struct udp_pcb *pcb;
-    HevTaskMutex *mutex;
+    HevMutex *mutex;
     int frames;
+    int mmsg;
 };
 
 struct _HevSocks5SessionUDPClass
@@ -37,6 +41,6 @@ int hev_socks5_session_udp_construct (HevSocks5SessionUDP *self);
 void hev_socks5_session_udp_destruct (HevSocks5Session *base);
 
 HevSocks5SessionUDP *hev_socks5_session_udp_new (struct udp_pcb *pcb,
-                                                 HevTaskMutex *mutex);
+                                                 HevMutex *mutex);
 
 #endif /* __HEV_SOCKS5_SESSION_UDP_H__ */
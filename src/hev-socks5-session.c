@@ -7,10 +7,23 @@
  ============================================================================
  */
 
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <lwip/ip.h>
+
+#include <hev-task.h>
+#include <hev-task-io-socket.h>
 #include <hev-memory-allocator.h>
+#include <hev-socks5-misc.h>
 
 #include "hev-logger.h"
 #include "hev-config.h"
+#include "hev-socks5-pool.h"
+#include "hev-socks5-worker.h"
 
 #include "hev-socks5-session.h"
 
@@ -25,6 +38,7 @@ hev_socks5_session_construct (HevSocks5Session *self)
     LOG_D ("%p socks5 session construct", self);
 
     HEV_SOCKS5_SESSION (self)->klass = HEV_SOCKS5_SESSION_CLASS (&_klass);
+    self->worker = -1;
 
     return 0;
 }
@@ -34,6 +48,10 @@ hev_socks5_session_destruct (HevSocks5Session *self)
 {
     LOG_D ("%p socks5 session destruct", self);
 
+    /* the pcbs are already detached, so no new wakeups can be queued;
+     * drop any still sitting in the worker's wake list */
+    hev_socks5_worker_session_detach (self);
+
     hev_socks5_unref (HEV_SOCKS5 (self->client));
     hev_free (self);
 }
@@ -48,6 +66,63 @@ hev_socks5_session_destroy (HevSocks5Session *self)
     klass->finalizer (self);
 }
 
+/*
+ * Connect straight to the destination from the session key, skipping
+ * the proxy hop; the client object stays on as the fd holder so the
+ * splice and teardown paths are unchanged.
+ */
+static int
+hev_socks5_session_bypass_connect (HevSocks5Session *self)
+{
+    struct sockaddr_in6 addr = { 0 };
+    socklen_t alen;
+    int type;
+    int res;
+    int fd;
+
+    type = (self->key.proto == IP_PROTO_TCP) ? SOCK_STREAM : SOCK_DGRAM;
+
+    if (self->key.family == 6) {
+        struct sockaddr_in6 *adp = &addr;
+
+        adp->sin6_family = AF_INET6;
+        adp->sin6_port = htons (self->key.dport);
+        memcpy (&adp->sin6_addr, self->key.daddr, 16);
+        alen = sizeof (struct sockaddr_in6);
+    } else {
+        struct sockaddr_in *adp = (struct sockaddr_in *)&addr;
+
+        adp->sin_family = AF_INET;
+        adp->sin_port = htons (self->key.dport);
+        memcpy (&adp->sin_addr, self->key.daddr, 4);
+        alen = sizeof (struct sockaddr_in);
+    }
+
+    fd = hev_task_io_socket_socket (addr.sin6_family, type, 0);
+    if (fd < 0)
+        return -1;
+
+    /* the proxy path registers the fd inside client connect; the
+     * direct path owns the fd and must register it itself */
+    res = hev_task_add_fd (hev_task_self (), fd, POLLIN | POLLOUT);
+    if (res < 0) {
+        close (fd);
+        return -1;
+    }
+
+    res = hev_task_io_socket_connect (fd, (struct sockaddr *)&addr, alen,
+                                      hev_socks5_task_io_yielder,
+                                      self->client);
+    if (res < 0) {
+        close (fd);
+        return -1;
+    }
+
+    HEV_SOCKS5 (self->client)->fd = fd;
+
+    return 0;
+}
+
 void
 hev_socks5_session_run (HevSocks5Session *self)
 {
@@ -66,10 +141,35 @@ hev_socks5_session_run (HevSocks5Session *self)
 
     hev_socks5_set_timeout (HEV_SOCKS5 (self->client), connect_timeout);
 
-    res = hev_socks5_client_connect (self->client, addr, port);
-    if (res < 0) {
-        LOG_E ("%p socks5 session connect", self);
-        return;
+    if (self->bypass) {
+        res = hev_socks5_session_bypass_connect (self);
+        if (res < 0) {
+            LOG_E ("%p socks5 session bypass connect", self);
+            return;
+        }
+        hev_socks5_set_timeout (HEV_SOCKS5 (self->client),
+                                read_write_timeout);
+        goto splice;
+    }
+
+    /* a pooled upstream is already connected; skip the handshake RTT.
+     * the normal path registers the fd inside client connect; a pooled
+     * fd needs the same for the handshake I/O */
+    res = hev_socks5_pool_acquire ();
+    if (res >= 0) {
+        if (hev_task_add_fd (hev_task_self (), res, POLLIN | POLLOUT) < 0) {
+            close (res);
+            res = -1;
+        }
+    }
+    if (res >= 0) {
+        HEV_SOCKS5 (self->client)->fd = res;
+    } else {
+        res = hev_socks5_client_connect (self->client, addr, port);
+        if (res < 0) {
+            LOG_E ("%p socks5 session connect", self);
+            return;
+        }
     }
 
     hev_socks5_set_timeout (HEV_SOCKS5 (self->client), read_write_timeout);
@@ -80,6 +180,7 @@ hev_socks5_session_run (HevSocks5Session *self)
         return;
     }
 
+splice:
     klass = HEV_SOCKS5_SESSION_GET_CLASS (self);
     klass->splicer (self);
 }
@@ -90,5 +191,18 @@ hev_socks5_session_terminate (HevSocks5Session *self)
     LOG_D ("%p socks5 session terminate", self);
 
     hev_socks5_set_timeout (HEV_SOCKS5 (self->client), 0);
-    hev_task_wakeup (self->task);
+    hev_socks5_session_wakeup (self);
+}
+
+void
+hev_socks5_session_wakeup (HevSocks5Session *self)
+{
+    if (self->worker >= 0) {
+        hev_socks5_worker_session_wakeup (self);
+        return;
+    }
+
+    /* may be unset while the session waits in a worker accept ring */
+    if (self->task)
+        hev_task_wakeup (self->task);
 }
@@ -10,6 +10,8 @@
 #ifndef __HEV_SOCKS5_SESSION_H__
 #define __HEV_SOCKS5_SESSION_H__
 
+#include <stdint.h>
+
 #include <hev-task.h>
 #include <hev-socks5-client.h>
 
@@ -20,17 +22,49 @@
 #define HEV_SOCKS5_SESSION_GET_CLASS(p) ((void *)((HevSocks5Session *)p)->klass)
 
 typedef struct _HevSocks5Session HevSocks5Session;
+typedef struct _HevSocks5SessionKey HevSocks5SessionKey;
 typedef struct _HevSocks5SessionClass HevSocks5SessionClass;
 
+struct _HevSocks5SessionKey
+{
+    uint8_t proto;
+    uint8_t family;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t saddr[16];
+    uint8_t daddr[16];
+};
+
 struct _HevSocks5Session
 {
     HevSocks5SessionClass *klass;
 
     HevListNode node;
+    HevListNode wake_node;
+    HevSocks5SessionKey key;
     HevSocks5Client *client;
     HevTask *task;
+    int worker;
+    uint8_t bypass;
+    uint8_t wake_queued;
+    int8_t priority;
+    uint16_t idle_ticks;
+    uint64_t idle_mark;
+
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t rx_packets;
 };
 
+/* relaxed: each counter has a single writer task */
+#define HEV_SESSION_STATS_ADD(s, field, val)                     \
+    __atomic_fetch_add (&HEV_SOCKS5_SESSION (s)->field, (val), \
+                        __ATOMIC_RELAXED)
+
+#define HEV_SESSION_STATS_GET(s, field) \
+    __atomic_load_n (&HEV_SOCKS5_SESSION (s)->field, __ATOMIC_RELAXED)
+
 struct _HevSocks5SessionClass
 {
     const char *name;
@@ -47,4 +81,11 @@ void hev_socks5_session_destroy (HevSocks5Session *self);
 void hev_socks5_session_run (HevSocks5Session *self);
 void hev_socks5_session_terminate (HevSocks5Session *self);
 
+/*
+ * Thread-safe wakeup for use from the lwip callbacks: sessions owned
+ * by a worker are woken through the worker's eventfd, never directly
+ * across schedulers.
+ */
+void hev_socks5_session_wakeup (HevSocks5Session *self);
+
 #endif /* __HEV_SOCKS5_SESSION_H__ */
@@ -8,7 +8,11 @@
  */
 
 #include <signal.h>
+#include <stdint.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <linux/virtio_net.h>
 
 #include <lwip/tcp.h>
 #include <lwip/udp.h>
@@ -23,39 +27,62 @@
 #include <hev-task.h>
 #include <hev-task-io.h>
 #include <hev-task-io-pipe.h>
-#include <hev-task-mutex.h>
+#include "hev-mutex.h"
 #include <hev-task-system.h>
 #include <hev-memory-allocator.h>
 
 #include "hev-list.h"
+#include "hev-hash-table.h"
 #include "hev-config.h"
+#include "hev-config-const.h"
 #include "hev-logger.h"
 #include "hev-compiler.h"
+#include "hev-pbuf-pool.h"
+#include "hev-buffer-arena.h"
 #include "hev-tunnel-linux.h"
+#include "hev-socks5-worker.h"
+#include "hev-stats.h"
+#include "hev-socks5-pool.h"
+#include "hev-socks5-udp-relay.h"
+#include "hev-task-pool.h"
+#include "hev-io-uring.h"
+#include "hev-checksum.h"
+#include "hev-bypass.h"
+#include "hev-filter.h"
+#include "hev-session-manager.h"
+#include "hev-cpu.h"
 #include "hev-socks5-session-tcp.h"
 #include "hev-socks5-session-udp.h"
 
 #include "hev-socks5-tunnel.h"
 
 static int run;
-static int tun_fd;
+static int background;
+static int smp_workers;
+static int tun_queues;
+static int tun_vnet_hdr;
+static int timer_suspended;
+static int tun_fds[HEV_TUNNEL_LINUX_QUEUES_MAX];
 static int event_fds[2];
 
 static struct netif netif;
 static struct tcp_pcb *tcp;
 static struct udp_pcb *udp;
 
-static HevTaskMutex mutex;
+static HevMutex mutex;
 static HevTask *task_event;
-static HevTask *task_lwip_io;
+static HevTask *task_lwip_io[HEV_TUNNEL_LINUX_QUEUES_MAX];
 static HevTask *task_lwip_timer;
 static HevList session_set;
+static HevHashTable *session_tab;
 
 static int tunnel_init (void);
 static int gateway_init (void);
 static void sigint_handler (int signum);
+static void sighup_handler (int signum);
 static void event_task_entry (void *data);
 static void lwip_io_task_entry (void *data);
+static void lwip_timer_resume (void);
 static void lwip_timer_task_entry (void *data);
 static err_t tcp_accept_handler (void *arg, struct tcp_pcb *pcb, err_t err);
 static void udp_recv_handler (void *arg, struct udp_pcb *pcb, struct pbuf *p,
@@ -64,6 +91,8 @@ static void udp_recv_handler (void *arg, struct udp_pcb *pcb, struct pbuf *p,
 int
 hev_socks5_tunnel_init (int tunfd)
 {
+    int i;
+
     LOG_D ("socks5 tunnel init");
 
     if (hev_task_system_init () < 0) {
@@ -75,23 +104,59 @@ hev_socks5_tunnel_init (int tunfd)
         if (tunnel_init () < 0)
             goto exit_free_sys;
     } else {
-        tun_fd = tunfd;
+        tun_queues = 1;
+        tun_fds[0] = tunfd;
+    }
+
+    i = hev_config_get_tunnel_mtu ();
+    if (i < UDP_BUF_SIZE)
+        i = UDP_BUF_SIZE;
+    if (tun_vnet_hdr)
+        i = VNET_BUF_SIZE;
+    if (hev_pbuf_pool_init (i, PBUF_SLAB_COUNT,
+                            hev_config_get_misc_workers () > 1) < 0) {
+        LOG_E ("socks5 tunnel pbuf pool");
+        goto exit_close_tun;
+    }
+
+    if (hev_buffer_arena_init (hev_config_get_misc_tcp_buffer_size (),
+                               SPLICE_ARENA_COUNT,
+                               hev_config_get_misc_workers () > 1) < 0) {
+        LOG_E ("socks5 tunnel buffer arena");
+        goto exit_free_pool;
     }
 
     if (hev_task_io_pipe_pipe (event_fds) < 0) {
         LOG_E ("socks5 tunnel pipe");
-        goto exit_close_tun;
+        goto exit_free_arena;
     }
 
     if (gateway_init () < 0)
         goto exit_close_event;
 
-    hev_task_mutex_init (&mutex);
+    smp_workers = hev_config_get_misc_workers () - 1;
+    if (hev_mutex_init (&mutex, smp_workers > 0) < 0) {
+        LOG_E ("socks5 tunnel mutex");
+        goto exit_free_gateway;
+    }
+
+    if (smp_workers > 0) {
+        if (hev_socks5_worker_init (smp_workers) < 0) {
+            LOG_E ("socks5 tunnel workers");
+            goto exit_free_gateway;
+        }
+    }
+
+    session_tab = hev_hash_table_new (sizeof (HevSocks5SessionKey), 1024);
+    if (!session_tab) {
+        LOG_E ("socks5 tunnel session table");
+        goto exit_free_workers;
+    }
 
     task_event = hev_task_new (-1);
     if (!task_event) {
         LOG_E ("socks5 tunnel task event");
-        goto exit_free_gateway;
+        goto exit_free_session_tab;
     }
 
     if (hev_task_add_fd (task_event, event_fds[0], POLLIN) < 0) {
@@ -99,16 +164,19 @@ hev_socks5_tunnel_init (int tunfd)
         goto exit_free_task_event;
     }
 
-    task_lwip_io = hev_task_new (-1);
-    if (!task_lwip_io) {
-        LOG_E ("socks5 tunnel task lwip");
-        goto exit_free_task_event;
-    }
-    hev_task_set_priority (task_lwip_io, HEV_TASK_PRIORITY_REALTIME);
+    for (i = 0; i < tun_queues; i++) {
+        task_lwip_io[i] = hev_task_new (-1);
+        if (!task_lwip_io[i]) {
+            LOG_E ("socks5 tunnel task lwip");
+            goto exit_free_task_lwip_io;
+        }
+        hev_task_set_priority (task_lwip_io[i], HEV_TASK_PRIORITY_REALTIME);
 
-    if (hev_task_add_fd (task_lwip_io, tun_fd, POLLIN | POLLOUT) < 0) {
-        LOG_E ("socks5 tunnel add tunfd");
-        goto exit_free_task_lwip_io;
+        if (hev_task_add_fd (task_lwip_io[i], tun_fds[i],
+                             POLLIN | POLLOUT) < 0) {
+            LOG_E ("socks5 tunnel add tunfd");
+            goto exit_free_task_lwip_io;
+        }
     }
 
     task_lwip_timer = hev_task_new (-1);
@@ -118,24 +186,75 @@ hev_socks5_tunnel_init (int tunfd)
     }
     hev_task_set_priority (task_lwip_timer, HEV_TASK_PRIORITY_REALTIME);
 
+    if (hev_stats_init () < 0)
+        goto exit_free_task_lwip_timer;
+
+    if (hev_socks5_pool_init () < 0)
+        goto exit_free_stats;
+
+    if (hev_socks5_udp_relay_init (&mutex) < 0)
+        goto exit_free_s5_pool;
+
+    if (hev_task_pool_init () < 0)
+        goto exit_free_relay;
+
+    if (hev_bypass_init () < 0)
+        goto exit_free_task_pool;
+
+    if (hev_filter_init () < 0)
+        goto exit_free_bypass;
+
+    if (hev_config_get_misc_io_uring ())
+        hev_io_uring_init (256, smp_workers > 0);
+
+    if (hev_session_manager_init () < 0)
+        goto exit_free_filter;
+
     if (signal (SIGPIPE, SIG_IGN) == SIG_ERR) {
         LOG_E ("socks5 tunnel sigpipe");
-        goto exit_free_task_lwip_timer;
+        goto exit_free_session_manager;
     }
 
     if (signal (SIGINT, sigint_handler) == SIG_ERR) {
         LOG_E ("socks5 tunnel sigint");
-        goto exit_free_task_lwip_timer;
+        goto exit_free_session_manager;
+    }
+
+    if (signal (SIGHUP, sighup_handler) == SIG_ERR) {
+        LOG_E ("socks5 tunnel sighup");
+        goto exit_free_session_manager;
     }
 
     return 0;
 
+exit_free_session_manager:
+    hev_session_manager_fini ();
+exit_free_filter:
+    hev_filter_fini ();
+exit_free_bypass:
+    hev_bypass_fini ();
+exit_free_task_pool:
+    hev_task_pool_fini ();
+exit_free_relay:
+    hev_socks5_udp_relay_fini ();
+exit_free_s5_pool:
+    hev_socks5_pool_fini ();
+exit_free_stats:
+    hev_stats_fini ();
 exit_free_task_lwip_timer:
     hev_task_unref (task_lwip_timer);
 exit_free_task_lwip_io:
-    hev_task_unref (task_lwip_io);
+    for (i = 0; i < tun_queues; i++) {
+        if (task_lwip_io[i])
+            hev_task_unref (task_lwip_io[i]);
+    }
 exit_free_task_event:
     hev_task_unref (task_event);
+exit_free_session_tab:
+    hev_hash_table_destroy (session_tab);
+exit_free_workers:
+    if (smp_workers > 0)
+        hev_socks5_worker_fini ();
 exit_free_gateway:
     udp_remove (udp);
     tcp_close (tcp);
@@ -143,8 +262,13 @@ exit_free_gateway:
 exit_close_event:
     close (event_fds[0]);
     close (event_fds[1]);
+exit_free_arena:
+    hev_buffer_arena_fini ();
+exit_free_pool:
+    hev_pbuf_pool_fini ();
 exit_close_tun:
-    close (tun_fd);
+    for (i = 0; i < tun_queues; i++)
+        close (tun_fds[i]);
 exit_free_sys:
     hev_task_system_fini ();
 exit:
@@ -154,19 +278,37 @@ exit:
 void
 hev_socks5_tunnel_fini (void)
 {
+    int i;
+
     LOG_D ("socks5 tunnel fini");
 
+    hev_session_manager_fini ();
+    hev_filter_fini ();
+    hev_bypass_fini ();
+    hev_io_uring_fini ();
+    hev_task_pool_fini ();
+    hev_socks5_udp_relay_fini ();
+    hev_socks5_pool_fini ();
+    hev_stats_fini ();
     hev_task_unref (task_lwip_timer);
-    hev_task_unref (task_lwip_io);
+    for (i = 0; i < tun_queues; i++)
+        hev_task_unref (task_lwip_io[i]);
     hev_task_unref (task_event);
 
+    if (smp_workers > 0)
+        hev_socks5_worker_fini ();
+    hev_hash_table_destroy (session_tab);
+
     udp_remove (udp);
     tcp_close (tcp);
     netif_remove (&netif);
 
     close (event_fds[0]);
     close (event_fds[1]);
-    close (tun_fd);
+    hev_buffer_arena_fini ();
+    hev_pbuf_pool_fini ();
+    for (i = 0; i < tun_queues; i++)
+        close (tun_fds[i]);
 
     hev_task_system_fini ();
 }
@@ -174,14 +316,27 @@ hev_socks5_tunnel_fini (void)
 int
 hev_socks5_tunnel_run (void)
 {
+    int i;
+
     LOG_D ("socks5 tunnel run");
 
+    hev_cpu_affinity_apply (0);
+    hev_logger_run ();
     task_event = hev_task_ref (task_event);
     hev_task_run (task_event, event_task_entry, NULL);
-    task_lwip_io = hev_task_ref (task_lwip_io);
-    hev_task_run (task_lwip_io, lwip_io_task_entry, NULL);
+    for (i = 0; i < tun_queues; i++) {
+        task_lwip_io[i] = hev_task_ref (task_lwip_io[i]);
+        hev_task_run (task_lwip_io[i], lwip_io_task_entry,
+                      (void *)(intptr_t)i);
+    }
     task_lwip_timer = hev_task_ref (task_lwip_timer);
     hev_task_run (task_lwip_timer, lwip_timer_task_entry, NULL);
+    hev_stats_run ();
+    hev_socks5_pool_run ();
+    hev_socks5_udp_relay_run ();
+    hev_task_pool_run ();
+    hev_io_uring_run ();
+    hev_session_manager_run ();
 
     run = 1;
     hev_task_system_run ();
@@ -192,7 +347,7 @@ hev_socks5_tunnel_run (void)
 void
 hev_socks5_tunnel_stop (void)
 {
-    int val;
+    int val = 0;
 
     LOG_D ("socks5 tunnel stop");
 
@@ -203,25 +358,36 @@ hev_socks5_tunnel_stop (void)
         LOG_E ("socks5 tunnel write event");
 }
 
+void
+hev_socks5_tunnel_set_background (int bg)
+{
+    WRITE_ONCE (background, bg);
+}
+
 static int
 tunnel_init (void)
 {
     HevTunnelLinux *tun;
     const char *name, *ipv4, *ipv6;
     unsigned int mtu, ipv4_prefix, ipv6_prefix;
+    unsigned int queues;
+    int i;
 
     name = hev_config_get_tunnel_name ();
     mtu = hev_config_get_tunnel_mtu ();
+    queues = hev_config_get_tunnel_multi_queue ();
     ipv4 = hev_config_get_tunnel_ipv4_address ();
     ipv4_prefix = hev_config_get_tunnel_ipv4_prefix ();
     ipv6 = hev_config_get_tunnel_ipv6_address ();
     ipv6_prefix = hev_config_get_tunnel_ipv6_prefix ();
 
-    tun = hev_tunnel_linux_new (name);
+    tun = hev_tunnel_linux_new (name, queues,
+                                hev_config_get_tunnel_vnet_hdr ());
     if (!tun) {
         LOG_E ("socks5 tunnel new");
         goto exit;
     }
+    tun_vnet_hdr = hev_tunnel_linux_get_vnet_hdr (tun);
 
     if (hev_tunnel_linux_set_mtu (tun, mtu) < 0) {
         LOG_E ("socks5 tunnel mtu");
@@ -243,24 +409,45 @@ tunnel_init (void)
         goto exit_free;
     }
 
-    tun_fd = dup (hev_tunnel_linux_get_fd (tun));
-    if (tun_fd < 0) {
-        LOG_E ("socks5 tunnel dup fd");
-        goto exit_free;
+    for (i = 0; i < hev_tunnel_linux_get_queues (tun); i++) {
+        tun_fds[i] = dup (hev_tunnel_linux_get_fd (tun, i));
+        if (tun_fds[i] < 0) {
+            LOG_E ("socks5 tunnel dup fd");
+            goto exit_close;
+        }
+        tun_queues++;
     }
 
     hev_tunnel_linux_destroy (tun);
     return 0;
 
-exit_free:
+exit_close:
+    for (i = 0; i < tun_queues; i++)
+        close (tun_fds[i]);
+    tun_queues = 0;
     hev_tunnel_linux_destroy (tun);
 exit:
     return -1;
 }
 
+static unsigned int busy_poll_spins;
+
+/*
+ * Adaptive busy poll: the first misc.busy-poll WAITIO attempts stay on
+ * the run queue and re-poll instead of arming the poller, hiding the
+ * sleep/wakeup cost while packets are flowing. The budget refills on
+ * every successful TUN read, so an idle link still falls back to
+ * sleeping instead of burning the core.
+ */
 static int
 task_io_yielder (HevTaskYieldType type, void *data)
 {
+    if ((type == HEV_TASK_WAITIO) && !READ_ONCE (background) &&
+        (busy_poll_spins < (unsigned int)hev_config_get_misc_busy_poll ())) {
+        busy_poll_spins++;
+        type = HEV_TASK_YIELD;
+    }
+
     hev_task_yield (type);
 
     return run ? 0 : -1;
@@ -269,22 +456,29 @@ task_io_yielder (HevTaskYieldType type, void *data)
 static err_t
 netif_output_handler (struct netif *netif, struct pbuf *p)
 {
+    struct virtio_net_hdr vhdr = { 0 };
     ssize_t s;
 
-    if (p->next) {
+    if (tun_vnet_hdr || p->next) {
         struct iovec iov[512];
-        int i;
+        int i = 0;
+
+        if (tun_vnet_hdr) {
+            iov[i].iov_base = &vhdr;
+            iov[i].iov_len = sizeof (vhdr);
+            i++;
+        }
 
-        for (i = 0; (i < 512) && p; p = p->next) {
+        for (; (i < 512) && p; p = p->next) {
             iov[i].iov_base = p->payload;
             iov[i].iov_len = p->len;
             i++;
         }
 
-        s = hev_task_io_writev (tun_fd, iov, i, task_io_yielder, NULL);
+        s = hev_io_uring_writev (tun_fds[0], iov, i, task_io_yielder, NULL);
     } else {
-        s = hev_task_io_write (tun_fd, p->payload, p->len, task_io_yielder,
-                               NULL);
+        s = hev_io_uring_write (tun_fds[0], p->payload, p->len, task_io_yielder,
+                                NULL);
     }
 
     if (s <= 0) {
@@ -292,6 +486,9 @@ netif_output_handler (struct netif *netif, struct pbuf *p)
         return ERR_IF;
     }
 
+    HEV_STATS_ADD (tun_tx_packets, 1);
+    HEV_STATS_ADD (tun_tx_bytes, s);
+
     return ERR_OK;
 }
 
@@ -413,6 +610,18 @@ sigint_handler (int signum)
     hev_socks5_tunnel_stop ();
 }
 
+static void
+sighup_handler (int signum)
+{
+    int val = 1;
+
+    if (event_fds[1] == -1)
+        return;
+
+    if (write (event_fds[1], &val, sizeof (val)) == -1)
+        LOG_E ("socks5 tunnel write event");
+}
+
 static void
 event_task_entry (void *data)
 {
@@ -421,10 +630,32 @@ event_task_entry (void *data)
 
     LOG_D ("socks5 tunnel event task run");
 
-    hev_task_io_read (event_fds[0], &val, sizeof (val), NULL, NULL);
+    for (;;) {
+        if (hev_task_io_read (event_fds[0], &val, sizeof (val), NULL, NULL) <=
+            0)
+            break;
+
+        if (val != 1)
+            break;
+
+        /* reload off the signal context; new sessions pick it up */
+        if (hev_config_reload () < 0)
+            LOG_E ("socks5 tunnel config reload");
+        else if (hev_bypass_reload () < 0)
+            LOG_E ("socks5 tunnel bypass reload");
+        else if (hev_filter_reload () < 0)
+            LOG_E ("socks5 tunnel filter reload");
+    }
 
     run = 0;
-    hev_task_wakeup (task_lwip_io);
+    hev_stats_stop ();
+    hev_socks5_pool_stop ();
+    hev_socks5_udp_relay_stop ();
+    hev_task_pool_stop ();
+    hev_io_uring_stop ();
+    hev_session_manager_stop ();
+    for (val = 0; val < tun_queues; val++)
+        hev_task_wakeup (task_lwip_io[val]);
     hev_task_wakeup (task_lwip_timer);
 
     node = hev_list_first (&session_set);
@@ -434,56 +665,159 @@ event_task_entry (void *data)
         s = container_of (node, HevSocks5Session, node);
         hev_socks5_session_terminate (s);
     }
+
+    hev_logger_stop ();
+}
+
+static ssize_t
+tun_read_packet (int fd, struct pbuf *buf, HevTaskIOYielder yielder)
+{
+    if (buf->next) {
+        struct iovec iov[512];
+        struct pbuf *p;
+        int i;
+
+        for (i = 0, p = buf; (i < 512) && p; p = p->next) {
+            iov[i].iov_base = p->payload;
+            iov[i].iov_len = p->len;
+            i++;
+        }
+
+        if (yielder)
+            return hev_io_uring_readv (fd, iov, i, yielder, NULL);
+        return readv (fd, iov, i);
+    }
+
+    if (yielder)
+        return hev_io_uring_read (fd, buf->payload, buf->len, yielder, NULL);
+    return read (fd, buf->payload, buf->len);
+}
+
+/*
+ * Finish the partial checksum the kernel leaves behind when TUN_F_CSUM
+ * is negotiated, then hide the virtio-net header so lwip sees a plain
+ * IP packet (possibly a coalesced TSO segment).
+ */
+static int
+tun_vnet_hdr_parse (struct pbuf *buf, size_t size)
+{
+    struct virtio_net_hdr *vhdr = buf->payload;
+
+    if (size <= sizeof (*vhdr))
+        return -1;
+
+    if (vhdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+        uint8_t *pkt = (uint8_t *)buf->payload + sizeof (*vhdr);
+        size_t off = vhdr->csum_start;
+        size_t len = size - sizeof (*vhdr);
+        uint16_t sum;
+
+        if ((off + vhdr->csum_offset + 2) > len)
+            return -1;
+
+        memset (pkt + off + vhdr->csum_offset, 0, 2);
+        sum = ~hev_checksum (pkt + off, len - off);
+        memcpy (pkt + off + vhdr->csum_offset, &sum, 2);
+    }
+
+    pbuf_header (buf, -(s16_t)sizeof (*vhdr));
+    return 0;
 }
 
 static void
 lwip_io_task_entry (void *data)
 {
-    const unsigned int mtu = hev_config_get_tunnel_mtu ();
+    unsigned int mtu = hev_config_get_tunnel_mtu ();
+    const int tun_fd = tun_fds[(intptr_t)data];
+    const int batch = hev_config_get_misc_tun_batch_size ();
+    struct pbuf **bufs;
+    ssize_t bytes;
+    int i, n;
 
     LOG_D ("socks5 tunnel lwip task run");
 
+    if (tun_vnet_hdr)
+        mtu = VNET_BUF_SIZE;
+
+    bufs = hev_malloc0 (sizeof (struct pbuf *) * batch);
+    if (!bufs) {
+        LOG_E ("socks5 tunnel batch alloc");
+        return;
+    }
+
     for (; run;) {
-        struct pbuf *buf;
         ssize_t s;
 
-        hev_task_mutex_lock (&mutex);
-        buf = pbuf_alloc (PBUF_RAW, mtu, PBUF_RAM);
-        hev_task_mutex_unlock (&mutex);
-        if (!buf) {
+        hev_mutex_lock (&mutex);
+        for (n = 0; n < batch; n++) {
+            if (!bufs[n])
+                bufs[n] = hev_pbuf_pool_alloc (PBUF_RAW, mtu);
+            if (!bufs[n])
+                break;
+        }
+        hev_mutex_unlock (&mutex);
+        if (!n) {
             LOG_E ("socks5 tunnel alloc");
+            hev_session_manager_shed ();
             hev_task_sleep (100);
             continue;
         }
 
-        if (buf->next) {
-            struct iovec iov[512];
-            struct pbuf *p;
-            int i;
-
-            for (i = 0, p = buf; (i < 512) && p; p = p->next) {
-                iov[i].iov_base = p->payload;
-                iov[i].iov_len = p->len;
-                i++;
-            }
-
-            s = hev_task_io_readv (tun_fd, iov, i, task_io_yielder, NULL);
-        } else {
-            s = hev_task_io_read (tun_fd, buf->payload, buf->len,
-                                  task_io_yielder, NULL);
-        }
-
+        s = tun_read_packet (tun_fd, bufs[0], task_io_yielder);
         if (s <= 0) {
             LOG_E ("socks5 tunnel read");
-            pbuf_free (buf);
             continue;
         }
+        busy_poll_spins = 0;
+        bytes = s;
+        if (tun_vnet_hdr && (tun_vnet_hdr_parse (bufs[0], s) < 0))
+            continue;
+
+        for (i = 1; i < n; i++) {
+            s = tun_read_packet (tun_fd, bufs[i], NULL);
+            if (s <= 0)
+                break;
+            if (tun_vnet_hdr && (tun_vnet_hdr_parse (bufs[i], s) < 0))
+                break;
+            bytes += s;
+        }
+
+        HEV_STATS_ADD (tun_rx_packets, i);
+        HEV_STATS_ADD (tun_rx_bytes, bytes);
+
+        hev_mutex_lock (&mutex);
+        for (n = 0; n < i; n++) {
+            if (netif.input (bufs[n], &netif) != ERR_OK)
+                pbuf_free (bufs[n]);
+            bufs[n] = NULL;
+        }
+        lwip_timer_resume ();
+        hev_mutex_unlock (&mutex);
+
+        /*
+         * Doze: let packets pile up in the TUN queue so the next pass
+         * drains a full batch in one wakeup instead of one per packet.
+         */
+        if (READ_ONCE (background))
+            hev_task_sleep (20);
+    }
 
-        hev_task_mutex_lock (&mutex);
-        if (netif.input (buf, &netif) != ERR_OK)
-            pbuf_free (buf);
-        hev_task_mutex_unlock (&mutex);
+    for (n = 0; n < batch; n++) {
+        if (bufs[n])
+            pbuf_free (bufs[n]);
     }
+    hev_free (bufs);
+}
+
+/* called with the lwip mutex held */
+static void
+lwip_timer_resume (void)
+{
+    if (!timer_suspended)
+        return;
+
+    timer_suspended = 0;
+    hev_task_wakeup (task_lwip_timer);
 }
 
 static void
@@ -494,11 +828,50 @@ lwip_timer_task_entry (void *data)
     LOG_D ("socks5 tunnel timer task run");
 
     for (i = 1;; i++) {
-        hev_task_sleep (TCP_TMR_INTERVAL);
+        int idle;
+
+        /*
+         * With no active or TIME-WAIT pcbs tcp_tmr has nothing to
+         * drive, but the reassembly and nd6 timers still reap state
+         * fed by UDP-only load; fall back to one coarse tick a second
+         * (their native cadence) instead of waking every 250 ms.
+         */
+        hev_mutex_lock (&mutex);
+        idle = !tcp_active_pcbs && !tcp_tw_pcbs;
+        if (idle)
+            timer_suspended = 1;
+        hev_mutex_unlock (&mutex);
+
+        if (idle) {
+            hev_task_sleep (1000);
+            if (!run)
+                break;
+
+            /* resume cuts the sleep short when a tcp pcb shows up */
+            hev_mutex_lock (&mutex);
+            timer_suspended = 0;
+#if IP_REASSEMBLY
+            ip_reass_tmr ();
+#endif
+#if LWIP_IPV6
+            nd6_tmr ();
+#if LWIP_IPV6_REASS
+            ip6_reass_tmr ();
+#endif
+#endif
+            hev_mutex_unlock (&mutex);
+            continue;
+        }
+
+        /* doze: one coarse tick carries four timer intervals */
+        if (READ_ONCE (background))
+            hev_task_sleep (TCP_TMR_INTERVAL * 4);
+        else
+            hev_task_sleep (TCP_TMR_INTERVAL);
         if (!run)
             break;
 
-        hev_task_mutex_lock (&mutex);
+        hev_mutex_lock (&mutex);
         tcp_tmr ();
 
         if ((i & 3) == 0) {
@@ -512,21 +885,139 @@ lwip_timer_task_entry (void *data)
 #endif
 #endif
         }
-        hev_task_mutex_unlock (&mutex);
+        hev_mutex_unlock (&mutex);
     }
 }
 
 static void
-hev_socks5_session_task_entry (void *data)
+session_key_init (HevSocks5SessionKey *key, uint8_t proto,
+                  const ip_addr_t *src, uint16_t sport, const ip_addr_t *dst,
+                  uint16_t dport)
+{
+    memset (key, 0, sizeof (HevSocks5SessionKey));
+
+    key->proto = proto;
+    key->family = src->type;
+    key->sport = sport;
+    key->dport = dport;
+
+    if (src->type == IPADDR_TYPE_V4) {
+        memcpy (key->saddr, src, 4);
+        memcpy (key->daddr, dst, 4);
+    } else {
+        memcpy (key->saddr, src, 16);
+        memcpy (key->daddr, dst, 16);
+    }
+}
+
+HevSocks5Session *
+hev_socks5_tunnel_session_lookup (const HevSocks5SessionKey *key)
+{
+    if (!session_tab)
+        return NULL;
+
+    return hev_hash_table_lookup (session_tab, key);
+}
+
+unsigned int
+hev_socks5_tunnel_session_count (void)
+{
+    if (!session_tab)
+        return 0;
+
+    return hev_hash_table_size (session_tab);
+}
+
+void
+hev_socks5_tunnel_foreach_session_locked (void (*func) (HevSocks5Session *s,
+                                                        void *data),
+                                          void *data)
+{
+    HevListNode *node;
+
+    node = hev_list_first (&session_set);
+    for (; node; node = hev_list_node_next (node))
+        func (container_of (node, HevSocks5Session, node), data);
+}
+
+void
+hev_socks5_tunnel_foreach_session (void (*func) (HevSocks5Session *s,
+                                                 void *data),
+                                   void *data)
+{
+    hev_mutex_lock (&mutex);
+    hev_socks5_tunnel_foreach_session_locked (func, data);
+    hev_mutex_unlock (&mutex);
+}
+
+static unsigned int
+session_key_hash (const HevSocks5SessionKey *key)
+{
+    const unsigned char *bytes = (const unsigned char *)key;
+    unsigned int hash = 2166136261u;
+    unsigned int i;
+
+    for (i = 0; i < sizeof (HevSocks5SessionKey); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * Interactive flows (well-known low-latency ports or EF/CS4+ DSCP)
+ * get a step above the default so bulk splice loops cannot sit in
+ * front of them on the run queue. Only active when ports are
+ * configured.
+ */
+static int
+session_priority (uint16_t dport, uint8_t tos)
 {
-    HevSocks5Session *s = data;
+    const uint16_t *ports;
+    uint8_t dscp = tos >> 2;
+    int count;
+    int i;
+
+    count = hev_config_get_misc_priority_ports (&ports);
+    if (!count)
+        return HEV_TASK_PRIORITY_DEFAULT;
+
+    if ((dscp == 46) || (dscp >= 32))
+        return HEV_TASK_PRIORITY_DEFAULT - 1;
+
+    for (i = 0; i < count; i++) {
+        if (ports[i] == dport)
+            return HEV_TASK_PRIORITY_DEFAULT - 1;
+    }
+
+    return HEV_TASK_PRIORITY_DEFAULT;
+}
 
+void
+hev_socks5_tunnel_run_session (HevSocks5Session *s)
+{
     hev_socks5_session_run (s);
+    hev_socks5_tunnel_discard_session (s);
+}
 
+void
+hev_socks5_tunnel_discard_session (HevSocks5Session *s)
+{
+    hev_mutex_lock (&mutex);
+    hev_hash_table_remove (session_tab, &s->key);
     hev_list_del (&session_set, &s->node);
+    hev_mutex_unlock (&mutex);
+    HEV_STATS_ADD (sessions, -1);
     hev_socks5_session_destroy (s);
 }
 
+static void
+hev_socks5_session_task_entry (void *data)
+{
+    hev_socks5_tunnel_run_session (data);
+}
+
 static err_t
 tcp_accept_handler (void *arg, struct tcp_pcb *pcb, err_t err)
 {
@@ -538,20 +1029,61 @@ tcp_accept_handler (void *arg, struct tcp_pcb *pcb, err_t err)
     if (err != ERR_OK)
         return err;
 
+    /* deny verdicts cost a table probe, not a session: reset the flow
+     * before any socks5 or task state is allocated */
+    if (hev_filter_reject ((const uint8_t *)&pcb->local_ip,
+                           pcb->local_ip.type, pcb->local_port)) {
+        HEV_STATS_ADD (filter_rejects, 1);
+        tcp_abort (pcb);
+        return ERR_ABRT;
+    }
+
+    if (hev_session_manager_admit () < 0) {
+        HEV_STATS_ADD (session_drops, 1);
+        return ERR_MEM;
+    }
+
     tcp = hev_socks5_session_tcp_new (pcb, &mutex);
-    if (!tcp)
+    if (!tcp) {
+        HEV_STATS_ADD (session_drops, 1);
         return ERR_MEM;
+    }
+    HEV_STATS_ADD (tcp_accepts, 1);
 
     s = HEV_SOCKS5_SESSION (tcp);
+    session_key_init (&s->key, IP_PROTO_TCP, &pcb->remote_ip, pcb->remote_port,
+                      &pcb->local_ip, pcb->local_port);
+    s->bypass = hev_bypass_match (s->key.daddr, s->key.family);
+    s->priority = session_priority (pcb->local_port, pcb->tos);
+    if (hev_hash_table_insert (session_tab, &s->key, s) < 0) {
+        HEV_STATS_ADD (session_drops, 1);
+        hev_socks5_session_destroy (s);
+        return ERR_ABRT;
+    }
+    hev_list_add_tail (&session_set, &s->node);
+    HEV_STATS_ADD (sessions, 1);
+
+    if (smp_workers > 0) {
+        if (hev_socks5_worker_dispatch (s, session_key_hash (&s->key)) == 0)
+            return ERR_OK;
+    }
+
+    if (hev_task_pool_dispatch (s) == 0)
+        return ERR_OK;
+
     stack_size = hev_config_get_misc_task_stack_size ();
     task = hev_task_new (stack_size);
     if (!task) {
+        HEV_STATS_ADD (session_drops, 1);
+        HEV_STATS_ADD (sessions, -1);
+        hev_hash_table_remove (session_tab, &s->key);
+        hev_list_del (&session_set, &s->node);
         hev_socks5_session_destroy (s);
         return ERR_ABRT;
     }
 
     s->task = task;
-    hev_list_add_tail (&session_set, &s->node);
+    hev_task_set_priority (task, s->priority);
     hev_task_run (task, hev_socks5_session_task_entry, tcp);
 
     return ERR_OK;
@@ -566,21 +1098,66 @@ udp_recv_handler (void *arg, struct udp_pcb *pcb, struct pbuf *p,
     int stack_size;
     HevTask *task;
 
+    /* the verdict comes before the relay adoption: denied flows must
+     * not get a relay slot either. dropping the pcb here leaves later
+     * packets to lwip, which answers unmatched ports with icmp
+     * unreachable */
+    if (hev_filter_reject ((const uint8_t *)&pcb->local_ip,
+                           pcb->local_ip.type, pcb->local_port)) {
+        HEV_STATS_ADD (filter_rejects, 1);
+        udp_remove (pcb);
+        return;
+    }
+
+    if (hev_socks5_udp_relay_adopt (pcb) == 0)
+        return;
+
+    if (hev_session_manager_admit () < 0) {
+        HEV_STATS_ADD (session_drops, 1);
+        udp_remove (pcb);
+        return;
+    }
+
     udp = hev_socks5_session_udp_new (pcb, &mutex);
     if (!udp) {
+        HEV_STATS_ADD (session_drops, 1);
         udp_remove (pcb);
         return;
     }
+    HEV_STATS_ADD (udp_accepts, 1);
 
     s = HEV_SOCKS5_SESSION (udp);
+    session_key_init (&s->key, IP_PROTO_UDP, &pcb->remote_ip, pcb->remote_port,
+                      &pcb->local_ip, pcb->local_port);
+    s->bypass = hev_bypass_match (s->key.daddr, s->key.family);
+    s->priority = session_priority (pcb->local_port, pcb->tos);
+    if (hev_hash_table_insert (session_tab, &s->key, s) < 0) {
+        HEV_STATS_ADD (session_drops, 1);
+        hev_socks5_session_destroy (s);
+        return;
+    }
+    hev_list_add_tail (&session_set, &s->node);
+    HEV_STATS_ADD (sessions, 1);
+
+    if (smp_workers > 0) {
+        if (hev_socks5_worker_dispatch (s, session_key_hash (&s->key)) == 0)
+            return;
+    }
+
+    if (hev_task_pool_dispatch (s) == 0)
+        return;
+
     stack_size = hev_config_get_misc_task_stack_size ();
     task = hev_task_new (stack_size);
     if (!task) {
+        HEV_STATS_ADD (sessions, -1);
+        hev_hash_table_remove (session_tab, &s->key);
+        hev_list_del (&session_set, &s->node);
         hev_socks5_session_destroy (s);
         return;
     }
 
     s->task = task;
-    hev_list_add_tail (&session_set, &s->node);
+    hev_task_set_priority (task, s->priority);
     hev_task_run (task, hev_socks5_session_task_entry, udp);
 }
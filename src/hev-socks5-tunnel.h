@@ -10,10 +10,30 @@
 #ifndef __HEV_SOCKS5_TUNNEL_H__
 #define __HEV_SOCKS5_TUNNEL_H__
 
+#include "hev-socks5-session.h"
+
 int hev_socks5_tunnel_init (int tunfd);
 void hev_socks5_tunnel_fini (void);
 
 int hev_socks5_tunnel_run (void);
 void hev_socks5_tunnel_stop (void);
+void hev_socks5_tunnel_set_background (int background);
+
+HevSocks5Session *
+hev_socks5_tunnel_session_lookup (const HevSocks5SessionKey *key);
+
+void hev_socks5_tunnel_run_session (HevSocks5Session *s);
+
+/* for dispatchers dropping queued sessions that never got a task */
+void hev_socks5_tunnel_discard_session (HevSocks5Session *s);
+
+unsigned int hev_socks5_tunnel_session_count (void);
+void hev_socks5_tunnel_foreach_session (void (*func) (HevSocks5Session *s,
+                                                      void *data),
+                                        void *data);
+/* for callers already holding the session mutex (lwip callbacks) */
+void hev_socks5_tunnel_foreach_session_locked (void (*func) (HevSocks5Session *s,
+                                                             void *data),
+                                               void *data);
 
 #endif /* __HEV_SOCKS5_TUNNEL_H__ */
@@ -0,0 +1,603 @@
+/*
+ ============================================================================
+ Name        : hev-socks5-udp-relay.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Socks5 UDP Relay
+ ============================================================================
+ */
+
+/*
+ * Short-lived DNS flows multiplex over a small set of persistent
+ * SOCKS5 UDP associations instead of one association per flow. The
+ * SOCKS5 UDP reply only carries the remote endpoint, so replies are
+ * demultiplexed by (remote endpoint, DNS transaction id); that limits
+ * the shared path to port 53, where the id is always present.
+ */
+
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include <hev-task.h>
+#include <hev-task-io.h>
+#include <hev-task-io-socket.h>
+#include <hev-memory-allocator.h>
+#include <hev-socks5-udp.h>
+#include <hev-socks5-misc.h>
+#include <hev-socks5-client-udp.h>
+
+#include "hev-list.h"
+#include "hev-config.h"
+#include "hev-logger.h"
+#include "hev-compiler.h"
+#include "hev-pbuf-pool.h"
+#include "hev-hash-table.h"
+#include "hev-config-const.h"
+
+#include "hev-socks5-udp-relay.h"
+
+#define task_io_yielder hev_socks5_task_io_yielder
+
+#define RELAY_PORT (53)
+#define RELAY_FLOW_TIMEOUT (5000)
+#define RELAY_FRAME_MAX (512)
+
+typedef struct _HevUdpRelay HevUdpRelay;
+typedef struct _HevUdpRelayKey HevUdpRelayKey;
+typedef struct _HevUdpRelayPcb HevUdpRelayPcb;
+typedef struct _HevUdpRelayFlow HevUdpRelayFlow;
+typedef struct _HevUdpRelayFrame HevUdpRelayFrame;
+
+struct _HevUdpRelayKey
+{
+    uint8_t family;
+    uint8_t zero;
+    uint16_t port;
+    uint16_t txid;
+    uint8_t addr[16];
+};
+
+struct _HevUdpRelayPcb
+{
+    HevListNode node;
+    struct udp_pcb *pcb;
+    int refs;
+    uint64_t deadline;
+};
+
+struct _HevUdpRelayFlow
+{
+    HevListNode node;
+    HevUdpRelayKey key;
+    HevUdpRelayPcb *pr;
+    uint64_t deadline;
+};
+
+struct _HevUdpRelayFrame
+{
+    HevListNode node;
+    struct pbuf *data;
+    struct sockaddr_in6 addr;
+};
+
+struct _HevUdpRelay
+{
+    HevSocks5ClientUDP *client;
+    HevTask *task;
+    HevList frames;
+    int frame_count;
+};
+
+static HevUdpRelay relays[HEV_SOCKS5_UDP_RELAY_MAX];
+static HevList flow_list;
+static HevList pcb_list;
+static HevHashTable *flow_tab;
+static HevMutex *relay_mutex;
+static int relay_count;
+static int relay_running;
+
+static uint64_t
+relay_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+relay_io_yielder (HevTaskYieldType type, void *data)
+{
+    hev_task_yield (type);
+
+    return relay_running ? 0 : -1;
+}
+
+static void
+relay_pcb_unref (HevUdpRelayPcb *pr)
+{
+    if (--pr->refs)
+        return;
+
+    hev_free (pr);
+}
+
+static void
+relay_pcb_close (HevUdpRelayPcb *pr)
+{
+    hev_list_del (&pcb_list, &pr->node);
+    udp_recv (pr->pcb, NULL, NULL);
+    udp_remove (pr->pcb);
+    pr->pcb = NULL;
+    relay_pcb_unref (pr);
+}
+
+static void
+relay_flow_del (HevUdpRelayFlow *flow)
+{
+    hev_hash_table_remove (flow_tab, &flow->key);
+    hev_list_del (&flow_list, &flow->node);
+    relay_pcb_unref (flow->pr);
+    hev_free (flow);
+}
+
+/* called with the lwip mutex held */
+static void
+relay_flow_sweep (void)
+{
+    uint64_t now = relay_now ();
+    HevListNode *node;
+
+    node = hev_list_first (&flow_list);
+    while (node) {
+        HevUdpRelayFlow *flow;
+
+        flow = container_of (node, HevUdpRelayFlow, node);
+        if (flow->deadline > now)
+            break;
+
+        node = hev_list_node_next (node);
+        relay_flow_del (flow);
+    }
+
+    node = hev_list_first (&pcb_list);
+    while (node) {
+        HevUdpRelayPcb *pr;
+
+        pr = container_of (node, HevUdpRelayPcb, node);
+        node = hev_list_node_next (node);
+        if ((pr->deadline <= now) && (pr->refs == 1))
+            relay_pcb_close (pr);
+    }
+}
+
+static void
+relay_key_init (HevUdpRelayKey *key, const ip_addr_t *addr, uint16_t port,
+                uint16_t txid)
+{
+    memset (key, 0, sizeof (HevUdpRelayKey));
+
+    key->family = addr->type;
+    key->port = port;
+    key->txid = txid;
+
+    if (addr->type == IPADDR_TYPE_V4)
+        memcpy (key->addr, addr, 4);
+    else
+        memcpy (key->addr, addr, 16);
+}
+
+static void
+relay_recv_handler (void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                    const ip_addr_t *addr, u16_t port)
+{
+    HevUdpRelayPcb *pr = arg;
+    HevUdpRelayFlow *flow;
+    HevUdpRelayFrame *frame;
+    HevUdpRelay *relay;
+    uint32_t txid32;
+    uint16_t txid;
+
+    if (!p)
+        return;
+
+    if (p->len < 2) {
+        pbuf_free (p);
+        return;
+    }
+    memcpy (&txid, p->payload, 2);
+
+    pr->deadline = relay_now () + RELAY_FLOW_TIMEOUT;
+    hev_list_del (&pcb_list, &pr->node);
+    hev_list_add_tail (&pcb_list, &pr->node);
+
+    /* the reply path cannot be the only sweeper: a resolver that never
+     * answers would otherwise pin flows and pcbs forever. runs after
+     * this pcb's deadline refresh so it cannot close the pcb we are
+     * handling */
+    relay_flow_sweep ();
+
+    memcpy (&txid32, &pcb->remote_ip, 4);
+    relay = &relays[(txid32 ^ pcb->remote_port) % relay_count];
+    if (relay->frame_count > RELAY_FRAME_MAX) {
+        pbuf_free (p);
+        return;
+    }
+
+    flow = hev_malloc0 (sizeof (HevUdpRelayFlow));
+    if (!flow) {
+        pbuf_free (p);
+        return;
+    }
+
+    relay_key_init (&flow->key, &pcb->local_ip, pcb->local_port, txid);
+    flow->deadline = relay_now () + RELAY_FLOW_TIMEOUT;
+    flow->pr = pr;
+
+    /* a retransmitted query replaces its older entry */
+    if (hev_hash_table_lookup (flow_tab, &flow->key)) {
+        hev_free (flow);
+        flow = NULL;
+    } else if (hev_hash_table_insert (flow_tab, &flow->key, flow) < 0) {
+        hev_free (flow);
+        pbuf_free (p);
+        return;
+    } else {
+        pr->refs++;
+        hev_list_add_tail (&flow_list, &flow->node);
+    }
+
+    frame = hev_malloc0 (sizeof (HevUdpRelayFrame));
+    if (!frame) {
+        if (flow)
+            relay_flow_del (flow);
+        pbuf_free (p);
+        return;
+    }
+
+    frame->data = p;
+    if (pcb->local_ip.type == IPADDR_TYPE_V4) {
+        struct sockaddr_in *adp = (struct sockaddr_in *)&frame->addr;
+
+        adp->sin_family = AF_INET;
+        adp->sin_port = htons (pcb->local_port);
+        memcpy (&adp->sin_addr, &pcb->local_ip, 4);
+    } else {
+        struct sockaddr_in6 *adp = (struct sockaddr_in6 *)&frame->addr;
+
+        adp->sin6_family = AF_INET6;
+        adp->sin6_port = htons (pcb->local_port);
+        memcpy (&adp->sin6_addr, &pcb->local_ip, 16);
+    }
+
+    relay->frame_count++;
+    hev_list_add_tail (&relay->frames, &frame->node);
+    if (relay->task)
+        hev_task_wakeup (relay->task);
+}
+
+static int
+relay_fwd_f (HevUdpRelay *relay)
+{
+    HevSocks5UDP *udp = HEV_SOCKS5_UDP (relay->client);
+    int sent = 0;
+
+    for (;;) {
+        HevUdpRelayFrame *frame;
+        HevListNode *node;
+        int res;
+
+        hev_mutex_lock (relay_mutex);
+        node = hev_list_first (&relay->frames);
+        if (node) {
+            hev_list_del (&relay->frames, node);
+            relay->frame_count--;
+        }
+        hev_mutex_unlock (relay_mutex);
+        if (!node)
+            break;
+
+        frame = container_of (node, HevUdpRelayFrame, node);
+        res = hev_socks5_udp_sendto (udp, frame->data->payload,
+                                     frame->data->len,
+                                     (struct sockaddr *)&frame->addr);
+        pbuf_free (frame->data);
+        hev_free (frame);
+
+        if (res <= 0) {
+            LOG_E ("%p udp relay fwd f send", relay);
+            return -1;
+        }
+        sent++;
+    }
+
+    return sent;
+}
+
+static int
+relay_fwd_b (HevUdpRelay *relay)
+{
+    HevSocks5UDP *udp = HEV_SOCKS5_UDP (relay->client);
+    struct sockaddr_in6 ads = { 0 };
+    struct sockaddr *saddr;
+    HevUdpRelayFlow *flow;
+    HevUdpRelayKey key;
+    struct pbuf *buf;
+    ip_addr_t addr;
+    uint16_t txid;
+    uint16_t port;
+    err_t err;
+    int res;
+    int fd;
+
+    fd = HEV_SOCKS5 (udp)->fd;
+    if (fd < 0)
+        return -1;
+
+    res = recv (fd, &buf, 1, MSG_PEEK);
+    if (res <= 0) {
+        if ((res < 0) && (errno == EAGAIN))
+            return 0;
+        LOG_E ("%p udp relay fwd b peek", relay);
+        return -1;
+    }
+
+    hev_mutex_lock (relay_mutex);
+    buf = hev_pbuf_pool_alloc (PBUF_TRANSPORT, UDP_BUF_SIZE);
+    hev_mutex_unlock (relay_mutex);
+    if (!buf)
+        return -1;
+
+    saddr = (struct sockaddr *)&ads;
+    res = hev_socks5_udp_recvfrom (udp, buf->payload, buf->len, saddr);
+    if (res <= 0) {
+        LOG_E ("%p udp relay fwd b recv", relay);
+        pbuf_free (buf);
+        return -1;
+    }
+
+    if (saddr->sa_family == AF_INET) {
+        struct sockaddr_in *adp = (struct sockaddr_in *)saddr;
+
+        addr.type = IPADDR_TYPE_V4;
+        port = ntohs (adp->sin_port);
+        memcpy (&addr, &adp->sin_addr, 4);
+    } else if (saddr->sa_family == AF_INET6) {
+        struct sockaddr_in6 *adp = (struct sockaddr_in6 *)saddr;
+
+        addr.type = IPADDR_TYPE_V6;
+        port = ntohs (adp->sin6_port);
+        memcpy (&addr, &adp->sin6_addr, 16);
+    } else {
+        pbuf_free (buf);
+        return -1;
+    }
+
+    if (res < 2) {
+        pbuf_free (buf);
+        return 1;
+    }
+
+    buf->len = res;
+    buf->tot_len = res;
+    memcpy (&txid, buf->payload, 2);
+    relay_key_init (&key, &addr, port, txid);
+
+    hev_mutex_lock (relay_mutex);
+    flow = hev_hash_table_lookup (flow_tab, &key);
+    if (flow && flow->pr->pcb)
+        err = udp_sendfrom (flow->pr->pcb, buf, &addr, port);
+    else
+        err = ERR_ARG;
+    if (flow)
+        relay_flow_del (flow);
+    if (err != ERR_OK)
+        pbuf_free (buf);
+    relay_flow_sweep ();
+    hev_mutex_unlock (relay_mutex);
+
+    return 1;
+}
+
+static void
+relay_task_entry (void *data)
+{
+    HevUdpRelay *relay = data;
+    const char *addr;
+    int port;
+
+    addr = hev_config_get_socks5_address (&port);
+
+    while (relay_running) {
+        HevSocks5ClientUDP *client;
+        int res_f = 1;
+        int res_b = 1;
+        int res;
+
+        client = hev_socks5_client_udp_new ();
+        if (!client) {
+            hev_task_sleep (1000);
+            continue;
+        }
+        relay->client = client;
+
+        hev_socks5_set_timeout (HEV_SOCKS5 (client),
+                                hev_config_get_misc_connect_timeout ());
+        res = hev_socks5_client_connect (HEV_SOCKS5_CLIENT (client), addr,
+                                         port);
+        if (res == 0) {
+            /* the association stays up across flows */
+            hev_socks5_set_timeout (
+                HEV_SOCKS5 (client),
+                hev_config_get_misc_read_write_timeout ());
+            res = hev_socks5_client_handshake (HEV_SOCKS5_CLIENT (client));
+        }
+
+        for (; (res == 0) && relay_running;) {
+            HevTaskYieldType type;
+
+            if (res_f >= 0)
+                res_f = relay_fwd_f (relay);
+            if (res_b >= 0)
+                res_b = relay_fwd_b (relay);
+
+            if (res_f < 0 || res_b < 0)
+                break;
+            else if (res_f > 0 || res_b > 0)
+                type = HEV_TASK_YIELD;
+            else
+                type = HEV_TASK_WAITIO;
+
+            if (relay_io_yielder (type, client) < 0)
+                break;
+        }
+
+        relay->client = NULL;
+        hev_socks5_unref (HEV_SOCKS5 (client));
+        if (relay_running)
+            hev_task_sleep (1000);
+    }
+}
+
+int
+hev_socks5_udp_relay_init (HevMutex *mutex)
+{
+    int i;
+
+    relay_count = hev_config_get_misc_udp_relays ();
+    if (!relay_count)
+        return 0;
+
+    LOG_D ("socks5 udp relay init");
+
+    relay_mutex = mutex;
+
+    flow_tab = hev_hash_table_new (sizeof (HevUdpRelayKey), 256);
+    if (!flow_tab)
+        goto exit;
+
+    for (i = 0; i < relay_count; i++) {
+        relays[i].task = hev_task_new (-1);
+        if (!relays[i].task)
+            goto exit_free;
+    }
+
+    return 0;
+
+exit_free:
+    for (i--; i >= 0; i--) {
+        hev_task_unref (relays[i].task);
+        relays[i].task = NULL;
+    }
+    hev_hash_table_destroy (flow_tab);
+    flow_tab = NULL;
+exit:
+    relay_count = 0;
+    return -1;
+}
+
+void
+hev_socks5_udp_relay_fini (void)
+{
+    HevListNode *node;
+    int i;
+
+    if (!relay_count)
+        return;
+
+    LOG_D ("socks5 udp relay fini");
+
+    node = hev_list_first (&flow_list);
+    while (node) {
+        HevUdpRelayFlow *flow;
+
+        flow = container_of (node, HevUdpRelayFlow, node);
+        node = hev_list_node_next (node);
+        relay_flow_del (flow);
+    }
+
+    node = hev_list_first (&pcb_list);
+    while (node) {
+        HevUdpRelayPcb *pr;
+
+        pr = container_of (node, HevUdpRelayPcb, node);
+        node = hev_list_node_next (node);
+        relay_pcb_close (pr);
+    }
+
+    for (i = 0; i < relay_count; i++) {
+        HevUdpRelay *relay = &relays[i];
+
+        node = hev_list_first (&relay->frames);
+        while (node) {
+            HevUdpRelayFrame *frame;
+
+            frame = container_of (node, HevUdpRelayFrame, node);
+            node = hev_list_node_next (node);
+            pbuf_free (frame->data);
+            hev_free (frame);
+        }
+
+        hev_task_unref (relay->task);
+        relay->task = NULL;
+    }
+
+    hev_hash_table_destroy (flow_tab);
+    flow_tab = NULL;
+    relay_count = 0;
+}
+
+void
+hev_socks5_udp_relay_run (void)
+{
+    int i;
+
+    if (!relay_count)
+        return;
+
+    relay_running = 1;
+    for (i = 0; i < relay_count; i++) {
+        relays[i].task = hev_task_ref (relays[i].task);
+        hev_task_run (relays[i].task, relay_task_entry, &relays[i]);
+    }
+}
+
+void
+hev_socks5_udp_relay_stop (void)
+{
+    int i;
+
+    if (!relay_running)
+        return;
+
+    relay_running = 0;
+    for (i = 0; i < relay_count; i++)
+        hev_task_wakeup (relays[i].task);
+}
+
+int
+hev_socks5_udp_relay_adopt (struct udp_pcb *pcb)
+{
+    HevUdpRelayPcb *pr;
+
+    if (!relay_count || !relay_running)
+        return -1;
+
+    if (pcb->local_port != RELAY_PORT)
+        return -1;
+
+    pr = hev_malloc0 (sizeof (HevUdpRelayPcb));
+    if (!pr)
+        return -1;
+
+    pr->pcb = pcb;
+    pr->refs = 1;
+    pr->deadline = relay_now () + RELAY_FLOW_TIMEOUT;
+    hev_list_add_tail (&pcb_list, &pr->node);
+    udp_recv (pcb, relay_recv_handler, pr);
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ ============================================================================
+ Name        : hev-socks5-udp-relay.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Socks5 UDP Relay
+ ============================================================================
+ */
+
+#ifndef __HEV_SOCKS5_UDP_RELAY_H__
+#define __HEV_SOCKS5_UDP_RELAY_H__
+
+#include <lwip/udp.h>
+
+#include "hev-mutex.h"
+
+#define HEV_SOCKS5_UDP_RELAY_MAX (16)
+
+int hev_socks5_udp_relay_init (HevMutex *mutex);
+void hev_socks5_udp_relay_fini (void);
+
+void hev_socks5_udp_relay_run (void);
+void hev_socks5_udp_relay_stop (void);
+
+/*
+ * Take over a freshly accepted udp pcb when its flow belongs to the
+ * shared relay port class; returns -1 when the caller should set up a
+ * dedicated session instead.
+ */
+int hev_socks5_udp_relay_adopt (struct udp_pcb *pcb);
+
+#endif /* __HEV_SOCKS5_UDP_RELAY_H__ */
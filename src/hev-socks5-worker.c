@@ -0,0 +1,268 @@
+/*
+ ============================================================================
+ Name        : hev-socks5-worker.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Socks5 Worker
+ ============================================================================
+ */
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include <hev-task.h>
+#include <hev-task-system.h>
+#include <hev-memory-allocator.h>
+
+#include "hev-ring.h"
+#include "hev-list.h"
+#include "hev-mutex.h"
+#include "hev-config.h"
+#include "hev-compiler.h"
+#include "hev-logger.h"
+#include "hev-cpu.h"
+
+#include "hev-socks5-tunnel.h"
+
+#include "hev-socks5-worker.h"
+
+#define WORKER_RING_SIZE (1024)
+
+typedef struct _HevSocks5Worker HevSocks5Worker;
+
+struct _HevSocks5Worker
+{
+    pthread_t thread;
+    HevRing *ring;
+    HevTask *task_accept;
+    HevMutex wake_mutex;
+    HevList wake_list;
+    int event_fd;
+    int run;
+};
+
+static HevSocks5Worker *workers;
+static int workers_count;
+
+static void
+worker_session_task_entry (void *data)
+{
+    hev_socks5_tunnel_run_session (data);
+}
+
+static void
+worker_wake_drain (HevSocks5Worker *worker)
+{
+    for (;;) {
+        HevSocks5Session *s = NULL;
+        HevListNode *node;
+
+        hev_mutex_lock (&worker->wake_mutex);
+        node = hev_list_first (&worker->wake_list);
+        if (node) {
+            s = container_of (node, HevSocks5Session, wake_node);
+            hev_list_del (&worker->wake_list, node);
+            s->wake_queued = 0;
+        }
+        hev_mutex_unlock (&worker->wake_mutex);
+
+        if (!node)
+            break;
+
+        /* unset until this task picks the session off the ring */
+        if (s->task)
+            hev_task_wakeup (s->task);
+    }
+}
+
+static void
+worker_accept_task_entry (void *data)
+{
+    HevSocks5Worker *worker = data;
+
+    /* the main thread signals over the eventfd; waking a task owned by
+     * another thread's scheduler is not safe */
+    if (hev_task_add_fd (hev_task_self (), worker->event_fd, POLLIN) < 0)
+        LOG_E ("socks5 worker eventfd add");
+
+    for (; worker->run;) {
+        HevSocks5Session *s;
+        int stack_size;
+        HevTask *task;
+
+        worker_wake_drain (worker);
+
+        s = hev_ring_pop (worker->ring);
+        if (!s) {
+            uint64_t val;
+
+            read (worker->event_fd, &val, sizeof (val));
+            hev_task_yield (HEV_TASK_WAITIO);
+            continue;
+        }
+
+        stack_size = hev_config_get_misc_task_stack_size ();
+        task = hev_task_new (stack_size);
+        if (!task) {
+            hev_socks5_tunnel_run_session (s);
+            continue;
+        }
+
+        s->task = task;
+        hev_task_set_priority (task, s->priority);
+        hev_task_run (task, worker_session_task_entry, s);
+    }
+}
+
+static void *
+worker_thread_entry (void *data)
+{
+    HevSocks5Worker *worker = data;
+
+    hev_cpu_affinity_apply (1 + (int)(worker - workers));
+
+    if (hev_task_system_init () < 0) {
+        LOG_E ("socks5 worker task system");
+        return NULL;
+    }
+
+    worker->task_accept = hev_task_new (-1);
+    if (worker->task_accept) {
+        hev_task_run (worker->task_accept, worker_accept_task_entry, worker);
+        hev_task_system_run ();
+    }
+
+    hev_task_system_fini ();
+    return NULL;
+}
+
+int
+hev_socks5_worker_init (int count)
+{
+    int i;
+
+    LOG_D ("socks5 worker init");
+
+    workers = hev_malloc0 (sizeof (HevSocks5Worker) * count);
+    if (!workers)
+        goto exit;
+
+    for (i = 0; i < count; i++) {
+        HevSocks5Worker *worker = &workers[i];
+
+        worker->ring = hev_ring_new (WORKER_RING_SIZE);
+        if (!worker->ring)
+            goto exit_free;
+
+        if (hev_mutex_init (&worker->wake_mutex, 1) < 0) {
+            hev_ring_destroy (worker->ring);
+            worker->ring = NULL;
+            goto exit_free;
+        }
+
+        worker->event_fd = eventfd (0, EFD_NONBLOCK);
+        if (worker->event_fd < 0) {
+            hev_ring_destroy (worker->ring);
+            worker->ring = NULL;
+            goto exit_free;
+        }
+
+        worker->run = 1;
+        if (pthread_create (&worker->thread, NULL, worker_thread_entry,
+                            worker) != 0) {
+            hev_ring_destroy (worker->ring);
+            worker->ring = NULL;
+            close (worker->event_fd);
+            goto exit_free;
+        }
+        workers_count++;
+    }
+
+    return 0;
+
+exit_free:
+    hev_socks5_worker_fini ();
+exit:
+    return -1;
+}
+
+void
+hev_socks5_worker_fini (void)
+{
+    int i;
+
+    LOG_D ("socks5 worker fini");
+
+    for (i = 0; i < workers_count; i++) {
+        HevSocks5Worker *worker = &workers[i];
+        uint64_t val = 1;
+
+        worker->run = 0;
+        write (worker->event_fd, &val, sizeof (val));
+        pthread_join (worker->thread, NULL);
+        hev_ring_destroy (worker->ring);
+        close (worker->event_fd);
+    }
+    workers_count = 0;
+
+    hev_free (workers);
+    workers = NULL;
+}
+
+int
+hev_socks5_worker_dispatch (HevSocks5Session *s, unsigned int hash)
+{
+    HevSocks5Worker *worker;
+    uint64_t val = 1;
+
+    if (!workers_count)
+        return -1;
+
+    s->worker = hash % workers_count;
+    worker = &workers[s->worker];
+    if (hev_ring_push (worker->ring, s) < 0) {
+        s->worker = -1;
+        return -1;
+    }
+
+    write (worker->event_fd, &val, sizeof (val));
+
+    return 0;
+}
+
+void
+hev_socks5_worker_session_wakeup (HevSocks5Session *s)
+{
+    HevSocks5Worker *worker = &workers[s->worker];
+    uint64_t val = 1;
+
+    hev_mutex_lock (&worker->wake_mutex);
+    if (!s->wake_queued) {
+        s->wake_queued = 1;
+        hev_list_add_tail (&worker->wake_list, &s->wake_node);
+    }
+    hev_mutex_unlock (&worker->wake_mutex);
+
+    write (worker->event_fd, &val, sizeof (val));
+}
+
+void
+hev_socks5_worker_session_detach (HevSocks5Session *s)
+{
+    HevSocks5Worker *worker;
+
+    if (s->worker < 0)
+        return;
+
+    worker = &workers[s->worker];
+    hev_mutex_lock (&worker->wake_mutex);
+    if (s->wake_queued) {
+        hev_list_del (&worker->wake_list, &s->wake_node);
+        s->wake_queued = 0;
+    }
+    hev_mutex_unlock (&worker->wake_mutex);
+}
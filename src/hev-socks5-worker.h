@@ -0,0 +1,30 @@
+/*
+ ============================================================================
+ Name        : hev-socks5-worker.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Socks5 Worker
+ ============================================================================
+ */
+
+#ifndef __HEV_SOCKS5_WORKER_H__
+#define __HEV_SOCKS5_WORKER_H__
+
+#include "hev-socks5-session.h"
+
+int hev_socks5_worker_init (int count);
+void hev_socks5_worker_fini (void);
+
+int hev_socks5_worker_dispatch (HevSocks5Session *s, unsigned int hash);
+
+/*
+ * Cross-thread wakeup for a worker-owned session: queue it on the
+ * owning worker and signal the eventfd; the worker's accept task wakes
+ * the session task from its own scheduler.
+ */
+void hev_socks5_worker_session_wakeup (HevSocks5Session *s);
+
+/* called on the owning worker thread before the session is freed */
+void hev_socks5_worker_session_detach (HevSocks5Session *s);
+
+#endif /* __HEV_SOCKS5_WORKER_H__ */
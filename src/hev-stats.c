@@ -0,0 +1,257 @@
+/*
+ ============================================================================
+ Name        : hev-stats.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Stats
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <hev-task.h>
+#include <hev-task-io.h>
+#include <hev-task-io-socket.h>
+#include <hev-memory-allocator.h>
+
+#include "hev-config.h"
+#include "hev-logger.h"
+
+#include "hev-socks5-tunnel.h"
+#include "hev-pbuf-pool.h"
+#include "hev-buffer-arena.h"
+
+#include "hev-stats.h"
+
+HevStatsCounters hev_stats_counters;
+
+static HevTask *task_stats;
+static int listen_fd = -1;
+static int stats_run;
+
+typedef struct _HevStatsDump HevStatsDump;
+
+struct _HevStatsDump
+{
+    char *data;
+    unsigned int len;
+    unsigned int size;
+};
+
+static int
+stats_task_io_yielder (HevTaskYieldType type, void *data)
+{
+    hev_task_yield (type);
+
+    return stats_run ? 0 : -1;
+}
+
+static void
+stats_dump_printf (HevStatsDump *dump, const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    if (dump->len + 256 > dump->size) {
+        char *data;
+
+        data = hev_realloc (dump->data, dump->size * 2);
+        if (!data)
+            return;
+        dump->data = data;
+        dump->size *= 2;
+    }
+
+    va_start (ap, fmt);
+    len = vsnprintf (dump->data + dump->len, dump->size - dump->len, fmt, ap);
+    va_end (ap);
+
+    if (len > 0)
+        dump->len += len;
+}
+
+static void
+stats_dump_session (HevSocks5Session *s, void *data)
+{
+    HevStatsDump *dump = data;
+    char saddr[INET6_ADDRSTRLEN];
+    char daddr[INET6_ADDRSTRLEN];
+    int af;
+
+    af = (s->key.family == 6) ? AF_INET6 : AF_INET;
+    inet_ntop (af, s->key.saddr, saddr, sizeof (saddr));
+    inet_ntop (af, s->key.daddr, daddr, sizeof (daddr));
+
+    stats_dump_printf (dump, "session %u %s %u %s %u %llu %llu %llu %llu\n",
+                       s->key.proto, saddr, s->key.sport, daddr, s->key.dport,
+                       (unsigned long long)HEV_SESSION_STATS_GET (s, tx_bytes),
+                       (unsigned long long)HEV_SESSION_STATS_GET (s, rx_bytes),
+                       (unsigned long long)HEV_SESSION_STATS_GET (s,
+                                                                  tx_packets),
+                       (unsigned long long)HEV_SESSION_STATS_GET (s,
+                                                                  rx_packets));
+}
+
+static void
+stats_dump (int fd)
+{
+    HevStatsDump dump;
+
+    dump.size = 4096;
+    dump.len = 0;
+    dump.data = hev_malloc (dump.size);
+    if (!dump.data)
+        return;
+
+    stats_dump_printf (&dump, "tun-rx-packets %llu\n",
+                       (unsigned long long)HEV_STATS_GET (tun_rx_packets));
+    stats_dump_printf (&dump, "tun-rx-bytes %llu\n",
+                       (unsigned long long)HEV_STATS_GET (tun_rx_bytes));
+    stats_dump_printf (&dump, "tun-tx-packets %llu\n",
+                       (unsigned long long)HEV_STATS_GET (tun_tx_packets));
+    stats_dump_printf (&dump, "tun-tx-bytes %llu\n",
+                       (unsigned long long)HEV_STATS_GET (tun_tx_bytes));
+    stats_dump_printf (&dump, "tcp-accepts %llu\n",
+                       (unsigned long long)HEV_STATS_GET (tcp_accepts));
+    stats_dump_printf (&dump, "udp-accepts %llu\n",
+                       (unsigned long long)HEV_STATS_GET (udp_accepts));
+    stats_dump_printf (&dump, "session-drops %llu\n",
+                       (unsigned long long)HEV_STATS_GET (session_drops));
+    stats_dump_printf (&dump, "session-evicts %llu\n",
+                       (unsigned long long)HEV_STATS_GET (session_evicts));
+    stats_dump_printf (&dump, "filter-rejects %llu\n",
+                       (unsigned long long)HEV_STATS_GET (filter_rejects));
+    stats_dump_printf (&dump, "pbuf-pool-total %u\n",
+                       hev_pbuf_pool_get_total ());
+    stats_dump_printf (&dump, "pbuf-pool-used %u\n", hev_pbuf_pool_get_used ());
+    stats_dump_printf (&dump, "pbuf-pool-misses %u\n",
+                       hev_pbuf_pool_get_misses ());
+    stats_dump_printf (&dump, "buffer-arena-total %u\n",
+                       hev_buffer_arena_get_total ());
+    stats_dump_printf (&dump, "buffer-arena-used %u\n",
+                       hev_buffer_arena_get_used ());
+    stats_dump_printf (&dump, "buffer-arena-misses %u\n",
+                       hev_buffer_arena_get_misses ());
+    stats_dump_printf (&dump, "sessions %u\n",
+                       hev_socks5_tunnel_session_count ());
+
+    hev_socks5_tunnel_foreach_session (stats_dump_session, &dump);
+
+    hev_task_io_write (fd, dump.data, dump.len, stats_task_io_yielder, NULL);
+    hev_free (dump.data);
+}
+
+static void
+stats_task_entry (void *data)
+{
+    LOG_D ("stats task run");
+
+    for (; stats_run;) {
+        int fd;
+
+        fd = hev_task_io_socket_accept (listen_fd, NULL, NULL,
+                                        stats_task_io_yielder, NULL);
+        if (fd < 0)
+            break;
+
+        stats_dump (fd);
+        close (fd);
+    }
+}
+
+int
+hev_stats_init (void)
+{
+    struct sockaddr_un addr = { 0 };
+    const char *path;
+
+    path = hev_config_get_misc_stats_file ();
+    if (!path)
+        return 0;
+
+    LOG_D ("stats init");
+
+    listen_fd = hev_task_io_socket_socket (AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        LOG_E ("stats socket");
+        goto exit;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strncpy (addr.sun_path, path, sizeof (addr.sun_path) - 1);
+    unlink (path);
+
+    if (bind (listen_fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+        LOG_E ("stats bind");
+        goto exit_close;
+    }
+
+    if (listen (listen_fd, 5) < 0) {
+        LOG_E ("stats listen");
+        goto exit_close;
+    }
+
+    task_stats = hev_task_new (-1);
+    if (!task_stats) {
+        LOG_E ("stats task");
+        goto exit_close;
+    }
+
+    if (hev_task_add_fd (task_stats, listen_fd, POLLIN) < 0) {
+        LOG_E ("stats add fd");
+        goto exit_free_task;
+    }
+
+    return 0;
+
+exit_free_task:
+    hev_task_unref (task_stats);
+    task_stats = NULL;
+exit_close:
+    close (listen_fd);
+    listen_fd = -1;
+exit:
+    return -1;
+}
+
+void
+hev_stats_fini (void)
+{
+    if (listen_fd < 0)
+        return;
+
+    LOG_D ("stats fini");
+
+    hev_task_unref (task_stats);
+    task_stats = NULL;
+
+    close (listen_fd);
+    listen_fd = -1;
+}
+
+void
+hev_stats_run (void)
+{
+    if (listen_fd < 0)
+        return;
+
+    stats_run = 1;
+    task_stats = hev_task_ref (task_stats);
+    hev_task_run (task_stats, stats_task_entry, NULL);
+}
+
+void
+hev_stats_stop (void)
+{
+    if (!stats_run)
+        return;
+
+    stats_run = 0;
+    hev_task_wakeup (task_stats);
+}
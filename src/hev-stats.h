@@ -0,0 +1,51 @@
+/*
+ ============================================================================
+ Name        : hev-stats.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Stats
+ ============================================================================
+ */
+
+#ifndef __HEV_STATS_H__
+#define __HEV_STATS_H__
+
+#include <stdint.h>
+
+typedef struct _HevStatsCounters HevStatsCounters;
+
+struct _HevStatsCounters
+{
+    uint64_t tun_rx_packets;
+    uint64_t tun_rx_bytes;
+    uint64_t tun_tx_packets;
+    uint64_t tun_tx_bytes;
+    uint64_t tcp_accepts;
+    uint64_t udp_accepts;
+    uint64_t session_drops;
+    uint64_t session_evicts;
+    uint64_t filter_rejects;
+    uint64_t sessions;
+};
+
+/*
+ * Exported as one flat block of 64-bit counters, in declaration order:
+ * the Android JNI surface maps it into a direct ByteBuffer so samplers
+ * read it with plain loads, no call per sample.
+ */
+extern HevStatsCounters hev_stats_counters;
+
+/* relaxed: single writer per counter, readers tolerate staleness */
+#define HEV_STATS_ADD(field, val) \
+    __atomic_fetch_add (&hev_stats_counters.field, (val), __ATOMIC_RELAXED)
+
+#define HEV_STATS_GET(field) \
+    __atomic_load_n (&hev_stats_counters.field, __ATOMIC_RELAXED)
+
+int hev_stats_init (void);
+void hev_stats_fini (void);
+
+void hev_stats_run (void);
+void hev_stats_stop (void);
+
+#endif /* __HEV_STATS_H__ */
@@ -0,0 +1,219 @@
+/*
+ ============================================================================
+ Name        : hev-task-pool.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Session Task Pool
+ ============================================================================
+ */
+
+#include <hev-task.h>
+#include <hev-memory-allocator.h>
+
+#include "hev-list.h"
+#include "hev-ring.h"
+#include "hev-config.h"
+#include "hev-logger.h"
+#include "hev-compiler.h"
+
+#include "hev-socks5-tunnel.h"
+
+#include "hev-task-pool.h"
+
+#define TASK_POOL_RING_SIZE (1024)
+#define TASK_POOL_PRESPAWN (16)
+
+typedef struct _HevTaskPoolWorker HevTaskPoolWorker;
+
+struct _HevTaskPoolWorker
+{
+    HevListNode node;
+    HevTask *task;
+    int idle;
+};
+
+static HevRing *ring;
+static HevList idle_set;
+static HevTask *task_keeper;
+static int pool_run;
+
+static void
+task_pool_worker_entry (void *data)
+{
+    HevTaskPoolWorker *worker = data;
+
+    for (; pool_run;) {
+        HevSocks5Session *s;
+
+        s = hev_ring_pop (ring);
+        if (!s) {
+            worker->idle = 1;
+            hev_list_add_tail (&idle_set, &worker->node);
+            hev_task_yield (HEV_TASK_WAITIO);
+            if (worker->idle) {
+                hev_list_del (&idle_set, &worker->node);
+                worker->idle = 0;
+            }
+            continue;
+        }
+
+        s->task = hev_task_self ();
+        hev_task_set_priority (s->task, s->priority);
+        hev_socks5_tunnel_run_session (s);
+        hev_task_set_priority (hev_task_self (), HEV_TASK_PRIORITY_DEFAULT);
+    }
+
+    hev_free (worker);
+}
+
+static int
+task_pool_worker_spawn (void)
+{
+    HevTaskPoolWorker *worker;
+    int stack_size;
+
+    worker = hev_malloc0 (sizeof (HevTaskPoolWorker));
+    if (!worker)
+        return -1;
+
+    stack_size = hev_config_get_misc_task_stack_size ();
+    worker->task = hev_task_new (stack_size);
+    if (!worker->task) {
+        hev_free (worker);
+        return -1;
+    }
+
+    hev_task_run (worker->task, task_pool_worker_entry, worker);
+
+    return 0;
+}
+
+static void
+task_pool_keeper_entry (void *data)
+{
+    int i;
+
+    LOG_D ("task pool keeper run");
+
+    for (i = 0; i < TASK_POOL_PRESPAWN; i++) {
+        if (task_pool_worker_spawn () < 0)
+            break;
+    }
+
+    for (; pool_run;) {
+        for (; hev_ring_size (ring) && !hev_list_first (&idle_set);) {
+            if (task_pool_worker_spawn () < 0)
+                break;
+            hev_task_yield (HEV_TASK_YIELD);
+        }
+        hev_task_yield (HEV_TASK_WAITIO);
+    }
+}
+
+int
+hev_task_pool_init (void)
+{
+    LOG_D ("task pool init");
+
+    ring = hev_ring_new (TASK_POOL_RING_SIZE);
+    if (!ring) {
+        LOG_E ("task pool ring");
+        goto exit;
+    }
+
+    task_keeper = hev_task_new (-1);
+    if (!task_keeper) {
+        LOG_E ("task pool keeper");
+        goto exit_free_ring;
+    }
+
+    return 0;
+
+exit_free_ring:
+    hev_ring_destroy (ring);
+    ring = NULL;
+exit:
+    return -1;
+}
+
+void
+hev_task_pool_fini (void)
+{
+    if (!ring)
+        return;
+
+    LOG_D ("task pool fini");
+
+    hev_task_unref (task_keeper);
+    task_keeper = NULL;
+
+    hev_ring_destroy (ring);
+    ring = NULL;
+}
+
+void
+hev_task_pool_run (void)
+{
+    if (!ring)
+        return;
+
+    pool_run = 1;
+    task_keeper = hev_task_ref (task_keeper);
+    hev_task_run (task_keeper, task_pool_keeper_entry, NULL);
+}
+
+void
+hev_task_pool_stop (void)
+{
+    HevListNode *node;
+
+    if (!pool_run)
+        return;
+
+    pool_run = 0;
+    hev_task_wakeup (task_keeper);
+
+    /* sessions still queued never got a task; drop them along with
+     * their table entries and pcbs */
+    for (;;) {
+        HevSocks5Session *s = hev_ring_pop (ring);
+
+        if (!s)
+            break;
+        hev_socks5_tunnel_discard_session (s);
+    }
+
+    node = hev_list_first (&idle_set);
+    for (; node; node = hev_list_node_next (node)) {
+        HevTaskPoolWorker *worker;
+
+        worker = container_of (node, HevTaskPoolWorker, node);
+        hev_task_wakeup (worker->task);
+    }
+}
+
+int
+hev_task_pool_dispatch (HevSocks5Session *s)
+{
+    HevListNode *node;
+
+    if (!pool_run)
+        return -1;
+
+    if (hev_ring_push (ring, s) < 0)
+        return -1;
+
+    node = hev_list_first (&idle_set);
+    if (node) {
+        HevTaskPoolWorker *worker;
+
+        worker = container_of (node, HevTaskPoolWorker, node);
+        hev_list_del (&idle_set, &worker->node);
+        worker->idle = 0;
+        hev_task_wakeup (worker->task);
+    } else {
+        hev_task_wakeup (task_keeper);
+    }
+
+    return 0;
+}
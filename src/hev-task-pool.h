@@ -0,0 +1,27 @@
+/*
+ ============================================================================
+ Name        : hev-task-pool.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Session Task Pool
+ ============================================================================
+ */
+
+#ifndef __HEV_TASK_POOL_H__
+#define __HEV_TASK_POOL_H__
+
+#include "hev-socks5-session.h"
+
+int hev_task_pool_init (void);
+void hev_task_pool_fini (void);
+
+void hev_task_pool_run (void);
+void hev_task_pool_stop (void);
+
+/*
+ * Hand a freshly accepted session to a pooled worker task; returns -1
+ * when the queue is full and the caller should spawn a task itself.
+ */
+int hev_task_pool_dispatch (HevSocks5Session *s);
+
+#endif /* __HEV_TASK_POOL_H__ */
@@ -28,37 +28,65 @@
 
 struct _HevTunnelLinux
 {
-    int fd;
+    int queues;
+    int vnet_hdr;
+    int fds[HEV_TUNNEL_LINUX_QUEUES_MAX];
     char name[IFNAMSIZ];
 };
 
 HevTunnelLinux *
-hev_tunnel_linux_new (const char *name)
+hev_tunnel_linux_new (const char *name, int queues, int vnet_hdr)
 {
     HevTunnelLinux *self;
     struct ifreq ifr = { 0 };
+    int i;
+
+    if (queues < 1)
+        queues = 1;
+    else if (queues > HEV_TUNNEL_LINUX_QUEUES_MAX)
+        queues = HEV_TUNNEL_LINUX_QUEUES_MAX;
 
     self = hev_malloc0 (sizeof (HevTunnelLinux));
     if (!self)
         goto exit;
 
-    self->fd = hev_task_io_open ("/dev/net/tun", O_RDWR);
-    if (self->fd < 0)
-        goto exit_free;
-
     ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+    if (queues > 1)
+        ifr.ifr_flags |= IFF_MULTI_QUEUE;
+    if (vnet_hdr)
+        ifr.ifr_flags |= IFF_VNET_HDR;
     if (name)
         strncpy (ifr.ifr_name, name, IFNAMSIZ - 1);
 
-    if (ioctl (self->fd, TUNSETIFF, (void *)&ifr) < 0)
-        goto exit_close;
+    for (i = 0; i < queues; i++) {
+        self->fds[i] = hev_task_io_open ("/dev/net/tun", O_RDWR);
+        if (self->fds[i] < 0)
+            goto exit_close;
+
+        if (ioctl (self->fds[i], TUNSETIFF, (void *)&ifr) < 0) {
+            i++;
+            goto exit_close;
+        }
+        self->queues++;
+    }
+
+    if (vnet_hdr) {
+        unsigned int offload = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6;
+
+        /* header framing stays on even without segmentation offload */
+        for (i = 0; i < self->queues; i++) {
+            if (ioctl (self->fds[i], TUNSETOFFLOAD, offload) < 0)
+                ioctl (self->fds[i], TUNSETOFFLOAD, TUN_F_CSUM);
+        }
+        self->vnet_hdr = 1;
+    }
 
     memcpy (self->name, ifr.ifr_name, IFNAMSIZ);
     return self;
 
 exit_close:
-    close (self->fd);
-exit_free:
+    for (i--; i >= 0; i--)
+        close (self->fds[i]);
     hev_free (self);
 exit:
     return NULL;
@@ -67,7 +95,10 @@ exit:
 void
 hev_tunnel_linux_destroy (HevTunnelLinux *self)
 {
-    close (self->fd);
+    int i;
+
+    for (i = 0; i < self->queues; i++)
+        close (self->fds[i]);
     hev_free (self);
 }
 
@@ -176,7 +207,22 @@ exit:
 }
 
 int
-hev_tunnel_linux_get_fd (HevTunnelLinux *self)
+hev_tunnel_linux_get_queues (HevTunnelLinux *self)
 {
-    return self->fd;
+    return self->queues;
+}
+
+int
+hev_tunnel_linux_get_vnet_hdr (HevTunnelLinux *self)
+{
+    return self->vnet_hdr;
+}
+
+int
+hev_tunnel_linux_get_fd (HevTunnelLinux *self, int queue)
+{
+    if (queue < 0 || queue >= self->queues)
+        return -1;
+
+    return self->fds[queue];
 }
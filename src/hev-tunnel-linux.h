@@ -10,9 +10,12 @@
 #ifndef __HEV_TUNNEL_LINUX_H__
 #define __HEV_TUNNEL_LINUX_H__
 
+#define HEV_TUNNEL_LINUX_QUEUES_MAX (16)
+
 typedef struct _HevTunnelLinux HevTunnelLinux;
 
-HevTunnelLinux *hev_tunnel_linux_new (const char *name);
+HevTunnelLinux *hev_tunnel_linux_new (const char *name, int queues,
+                                      int vnet_hdr);
 void hev_tunnel_linux_destroy (HevTunnelLinux *self);
 
 int hev_tunnel_linux_set_mtu (HevTunnelLinux *self, int mtu);
@@ -24,6 +27,8 @@ int hev_tunnel_linux_set_ipv6 (HevTunnelLinux *self, const char *addr,
 
 int hev_tunnel_linux_set_state (HevTunnelLinux *self, int state);
 
-int hev_tunnel_linux_get_fd (HevTunnelLinux *self);
+int hev_tunnel_linux_get_queues (HevTunnelLinux *self);
+int hev_tunnel_linux_get_vnet_hdr (HevTunnelLinux *self);
+int hev_tunnel_linux_get_fd (HevTunnelLinux *self, int queue);
 
 #endif /* __HEV_TUNNEL_LINUX_H__ */
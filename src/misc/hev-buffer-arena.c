@@ -0,0 +1,134 @@
+/*
+ ============================================================================
+ Name        : hev-buffer-arena.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Buffer Arena
+ ============================================================================
+ */
+
+#include <stddef.h>
+
+#include <hev-memory-allocator.h>
+
+#include "hev-mutex.h"
+#include "hev-compiler.h"
+
+#include "hev-buffer-arena.h"
+
+typedef struct _HevBufferNode HevBufferNode;
+
+struct _HevBufferNode
+{
+    HevBufferNode *next;
+};
+
+static void *base;
+static void *limit;
+static HevBufferNode *free_list;
+static unsigned int buffer_step;
+static unsigned int buffer_total;
+static unsigned int buffer_used;
+static unsigned int buffer_misses;
+
+static HevMutex mutex;
+
+int
+hev_buffer_arena_init (unsigned int size, unsigned int count, int smp)
+{
+    unsigned int i;
+
+    if (hev_mutex_init (&mutex, smp) < 0)
+        return -1;
+
+    buffer_step = ALIGN_UP (size, 64);
+
+    base = hev_malloc (buffer_step * count);
+    if (!base)
+        return -1;
+    limit = base + buffer_step * count;
+
+    for (i = 0; i < count; i++) {
+        HevBufferNode *node = base + buffer_step * i;
+
+        node->next = free_list;
+        free_list = node;
+    }
+    buffer_total = count;
+
+    return 0;
+}
+
+void
+hev_buffer_arena_fini (void)
+{
+    free_list = NULL;
+    buffer_total = 0;
+    buffer_used = 0;
+
+    hev_free (base);
+    base = NULL;
+    limit = NULL;
+}
+
+void *
+hev_buffer_arena_alloc (void)
+{
+    HevBufferNode *node;
+
+    hev_mutex_lock (&mutex);
+    node = free_list;
+    if (node) {
+        free_list = node->next;
+        buffer_used++;
+    } else {
+        buffer_misses++;
+    }
+    hev_mutex_unlock (&mutex);
+
+    if (!node)
+        return hev_malloc (buffer_step);
+
+    return node;
+}
+
+void
+hev_buffer_arena_free (void *buffer)
+{
+    HevBufferNode *node = buffer;
+
+    if ((buffer < base) || (buffer >= limit)) {
+        hev_free (buffer);
+        return;
+    }
+
+    hev_mutex_lock (&mutex);
+    node->next = free_list;
+    free_list = node;
+    buffer_used--;
+    hev_mutex_unlock (&mutex);
+}
+
+unsigned int
+hev_buffer_arena_get_step (void)
+{
+    return buffer_step;
+}
+
+unsigned int
+hev_buffer_arena_get_total (void)
+{
+    return buffer_total;
+}
+
+unsigned int
+hev_buffer_arena_get_used (void)
+{
+    return buffer_used;
+}
+
+unsigned int
+hev_buffer_arena_get_misses (void)
+{
+    return buffer_misses;
+}
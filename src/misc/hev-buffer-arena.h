@@ -0,0 +1,24 @@
+/*
+ ============================================================================
+ Name        : hev-buffer-arena.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Buffer Arena
+ ============================================================================
+ */
+
+#ifndef __HEV_BUFFER_ARENA_H__
+#define __HEV_BUFFER_ARENA_H__
+
+int hev_buffer_arena_init (unsigned int size, unsigned int count, int smp);
+void hev_buffer_arena_fini (void);
+
+void *hev_buffer_arena_alloc (void);
+void hev_buffer_arena_free (void *buffer);
+
+unsigned int hev_buffer_arena_get_step (void);
+unsigned int hev_buffer_arena_get_total (void);
+unsigned int hev_buffer_arena_get_used (void);
+unsigned int hev_buffer_arena_get_misses (void);
+
+#endif /* __HEV_BUFFER_ARENA_H__ */
@@ -0,0 +1,121 @@
+/*
+ ============================================================================
+ Name        : hev-checksum.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Internet Checksum
+ ============================================================================
+ */
+
+#include <string.h>
+
+#include "hev-checksum.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#define __HEV_CHECKSUM_SSE2__ 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define __HEV_CHECKSUM_NEON__ 1
+#endif
+
+/*
+ * Sum the even-length, 16-bit aligned body. Lane accumulators are
+ * 32-bit: a lane overflows only after ~64K halfword adds, far beyond
+ * any packet, so folding happens once at the end.
+ */
+static uint32_t
+hev_checksum_words (const uint8_t *pb, int len, uint32_t sum)
+{
+#if defined(__AVX2__)
+    if (len >= 32) {
+        const __m256i zero = _mm256_setzero_si256 ();
+        __m256i vsum = zero;
+        uint32_t lanes[8];
+        int i;
+
+        for (; len >= 32; pb += 32, len -= 32) {
+            __m256i v = _mm256_loadu_si256 ((const __m256i *)pb);
+
+            vsum = _mm256_add_epi32 (vsum, _mm256_unpacklo_epi16 (v, zero));
+            vsum = _mm256_add_epi32 (vsum, _mm256_unpackhi_epi16 (v, zero));
+        }
+
+        _mm256_storeu_si256 ((__m256i *)lanes, vsum);
+        for (i = 0; i < 8; i++)
+            sum += lanes[i];
+    }
+#elif defined(__HEV_CHECKSUM_SSE2__)
+    if (len >= 16) {
+        const __m128i zero = _mm_setzero_si128 ();
+        __m128i vsum = zero;
+        uint32_t lanes[4];
+        int i;
+
+        for (; len >= 16; pb += 16, len -= 16) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)pb);
+
+            vsum = _mm_add_epi32 (vsum, _mm_unpacklo_epi16 (v, zero));
+            vsum = _mm_add_epi32 (vsum, _mm_unpackhi_epi16 (v, zero));
+        }
+
+        _mm_storeu_si128 ((__m128i *)lanes, vsum);
+        for (i = 0; i < 4; i++)
+            sum += lanes[i];
+    }
+#elif defined(__HEV_CHECKSUM_NEON__)
+    if (len >= 16) {
+        uint32x4_t vsum = vdupq_n_u32 (0);
+
+        for (; len >= 16; pb += 16, len -= 16)
+            vsum = vpadalq_u16 (vsum, vld1q_u16 ((const uint16_t *)pb));
+
+        sum += vgetq_lane_u32 (vsum, 0);
+        sum += vgetq_lane_u32 (vsum, 1);
+        sum += vgetq_lane_u32 (vsum, 2);
+        sum += vgetq_lane_u32 (vsum, 3);
+    }
+#endif
+
+    for (; len >= 2; pb += 2, len -= 2) {
+        uint16_t w;
+
+        memcpy (&w, pb, 2);
+        sum += w;
+    }
+
+    return sum;
+}
+
+uint16_t
+hev_checksum (const void *buf, int len)
+{
+    const uint8_t *pb = buf;
+    uint32_t sum = 0;
+    uint16_t t = 0;
+    int odd = 0;
+
+    /* align to a halfword boundary; swap at the end puts the lone
+     * leading byte back into its wire position */
+    if (((uintptr_t)pb & 1) && (len > 0)) {
+        odd = 1;
+        ((uint8_t *)&t)[1] = *pb++;
+        len--;
+    }
+
+    sum = hev_checksum_words (pb, len & ~1, sum);
+
+    if (len & 1)
+        ((uint8_t *)&t)[0] = pb[len - 1];
+    sum += t;
+
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    if (odd)
+        sum = ((sum & 0xff) << 8) | ((sum >> 8) & 0xff);
+
+    return sum;
+}
@@ -0,0 +1,24 @@
+/*
+ ============================================================================
+ Name        : hev-checksum.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Internet Checksum
+ ============================================================================
+ */
+
+#ifndef __HEV_CHECKSUM_H__
+#define __HEV_CHECKSUM_H__
+
+#include <stdint.h>
+
+/*
+ * Ones-complement sum over buf, folded to 16 bits but not inverted, in
+ * host byte order — the same contract as lwip_standard_chksum, so the
+ * lwip port layer can plug it in with LWIP_CHKSUM=hev_checksum. Vector
+ * lanes (SSE2/AVX2/NEON) are picked at compile time with a portable
+ * scalar fallback.
+ */
+uint16_t hev_checksum (const void *buf, int len);
+
+#endif /* __HEV_CHECKSUM_H__ */
@@ -0,0 +1,47 @@
+/*
+ ============================================================================
+ Name        : hev-cpu.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : CPU Affinity
+ ============================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "hev-config.h"
+#include "hev-logger.h"
+
+#include "hev-cpu.h"
+
+void
+hev_cpu_affinity_apply (int index)
+{
+#ifdef __linux__
+    const int32_t *cores;
+    cpu_set_t set;
+    int count;
+    int core;
+
+    count = hev_config_get_misc_cpu_affinity (&cores);
+    if (!count)
+        return;
+
+    core = cores[index % count];
+    CPU_ZERO (&set);
+    CPU_SET (core, &set);
+
+    if (pthread_setaffinity_np (pthread_self (), sizeof (set), &set) != 0) {
+        LOG_W ("cpu affinity core %d", core);
+        return;
+    }
+
+    LOG_D ("cpu affinity thread %d core %d", index, core);
+#endif
+}
@@ -0,0 +1,20 @@
+/*
+ ============================================================================
+ Name        : hev-cpu.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : CPU Affinity
+ ============================================================================
+ */
+
+#ifndef __HEV_CPU_H__
+#define __HEV_CPU_H__
+
+/*
+ * Pin the calling thread to the index-th core of misc.cpu-affinity;
+ * index 0 is the tunnel thread, workers follow round-robin. No-op when
+ * the list is empty or the platform has no affinity call.
+ */
+void hev_cpu_affinity_apply (int index);
+
+#endif /* __HEV_CPU_H__ */
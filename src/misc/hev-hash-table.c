@@ -0,0 +1,239 @@
+/*
+ ============================================================================
+ Name        : hev-hash-table.c
+ Authors     : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 everyone.
+ Description : Open-addressing Hash Table
+ ============================================================================
+ */
+
+#include <string.h>
+
+#include <hev-memory-allocator.h>
+
+#include "hev-hash-table.h"
+
+#define SLOT_EMPTY (0)
+#define SLOT_TOMB (1)
+#define SLOT_USED (2)
+
+typedef struct _HevHashTableSlot HevHashTableSlot;
+
+struct _HevHashTableSlot
+{
+    unsigned int hash;
+    unsigned char state;
+    void *value;
+    unsigned char key[];
+};
+
+struct _HevHashTable
+{
+    unsigned int key_size;
+    unsigned int slot_size;
+    unsigned int capacity;
+    unsigned int size;
+    unsigned int tombs;
+    void *slots;
+};
+
+static unsigned int
+hev_hash_table_hash (const unsigned char *key, unsigned int len)
+{
+    unsigned int hash = 2166136261u;
+    unsigned int i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+
+    return hash ? hash : 1;
+}
+
+static HevHashTableSlot *
+hev_hash_table_slot (HevHashTable *self, unsigned int index)
+{
+    return self->slots + self->slot_size * index;
+}
+
+static HevHashTableSlot *
+hev_hash_table_probe (HevHashTable *self, const void *key, unsigned int hash)
+{
+    HevHashTableSlot *tomb = NULL;
+    unsigned int i;
+
+    for (i = 0; i < self->capacity; i++) {
+        unsigned int index = (hash + i) & (self->capacity - 1);
+        HevHashTableSlot *slot = hev_hash_table_slot (self, index);
+
+        switch (slot->state) {
+        case SLOT_EMPTY:
+            return tomb ? tomb : slot;
+        case SLOT_TOMB:
+            if (!tomb)
+                tomb = slot;
+            break;
+        case SLOT_USED:
+            if ((slot->hash == hash) &&
+                (0 == memcmp (slot->key, key, self->key_size)))
+                return slot;
+            break;
+        }
+    }
+
+    return tomb;
+}
+
+static int
+hev_hash_table_grow (HevHashTable *self)
+{
+    unsigned int capacity = self->capacity * 2;
+    void *slots;
+    unsigned int i;
+
+    slots = hev_malloc0 (self->slot_size * capacity);
+    if (!slots)
+        return -1;
+
+    for (i = 0; i < self->capacity; i++) {
+        HevHashTableSlot *slot = hev_hash_table_slot (self, i);
+        unsigned int j;
+
+        if (slot->state != SLOT_USED)
+            continue;
+
+        for (j = 0; j < capacity; j++) {
+            unsigned int index = (slot->hash + j) & (capacity - 1);
+            HevHashTableSlot *nslot = slots + self->slot_size * index;
+
+            if (nslot->state != SLOT_EMPTY)
+                continue;
+
+            memcpy (nslot, slot, self->slot_size);
+            break;
+        }
+    }
+
+    hev_free (self->slots);
+    self->slots = slots;
+    self->capacity = capacity;
+    self->tombs = 0;
+
+    return 0;
+}
+
+HevHashTable *
+hev_hash_table_new (unsigned int key_size, unsigned int capacity)
+{
+    HevHashTable *self;
+    unsigned int cap;
+
+    for (cap = 16; cap < capacity;)
+        cap *= 2;
+
+    self = hev_malloc0 (sizeof (HevHashTable));
+    if (!self)
+        return NULL;
+
+    self->key_size = key_size;
+    self->slot_size = sizeof (HevHashTableSlot) + key_size;
+    self->slot_size = (self->slot_size + 7) & ~7u;
+    self->capacity = cap;
+
+    self->slots = hev_malloc0 (self->slot_size * cap);
+    if (!self->slots) {
+        hev_free (self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+hev_hash_table_destroy (HevHashTable *self)
+{
+    hev_free (self->slots);
+    hev_free (self);
+}
+
+int
+hev_hash_table_insert (HevHashTable *self, const void *key, void *value)
+{
+    HevHashTableSlot *slot;
+    unsigned int hash;
+
+    if ((self->size + self->tombs) * 4 >= self->capacity * 3) {
+        if (hev_hash_table_grow (self) < 0)
+            return -1;
+    }
+
+    hash = hev_hash_table_hash (key, self->key_size);
+    slot = hev_hash_table_probe (self, key, hash);
+    if (!slot)
+        return -1;
+
+    if (slot->state != SLOT_USED) {
+        if (slot->state == SLOT_TOMB)
+            self->tombs--;
+        slot->hash = hash;
+        slot->state = SLOT_USED;
+        memcpy (slot->key, key, self->key_size);
+        self->size++;
+    }
+    slot->value = value;
+
+    return 0;
+}
+
+void *
+hev_hash_table_lookup (HevHashTable *self, const void *key)
+{
+    HevHashTableSlot *slot;
+    unsigned int hash;
+
+    hash = hev_hash_table_hash (key, self->key_size);
+    slot = hev_hash_table_probe (self, key, hash);
+    if (!slot || (slot->state != SLOT_USED))
+        return NULL;
+
+    return slot->value;
+}
+
+int
+hev_hash_table_remove (HevHashTable *self, const void *key)
+{
+    HevHashTableSlot *slot;
+    unsigned int hash;
+
+    hash = hev_hash_table_hash (key, self->key_size);
+    slot = hev_hash_table_probe (self, key, hash);
+    if (!slot || (slot->state != SLOT_USED))
+        return -1;
+
+    slot->state = SLOT_TOMB;
+    slot->value = NULL;
+    self->size--;
+    self->tombs++;
+
+    return 0;
+}
+
+unsigned int
+hev_hash_table_size (HevHashTable *self)
+{
+    return self->size;
+}
+
+void
+hev_hash_table_foreach (HevHashTable *self, HevHashTableFunc func, void *data)
+{
+    unsigned int i;
+
+    for (i = 0; i < self->capacity; i++) {
+        HevHashTableSlot *slot = hev_hash_table_slot (self, i);
+
+        if (slot->state == SLOT_USED)
+            func (slot->value, data);
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ ============================================================================
+ Name        : hev-hash-table.h
+ Authors     : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 everyone.
+ Description : Open-addressing Hash Table
+ ============================================================================
+ */
+
+#ifndef __HEV_HASH_TABLE_H__
+#define __HEV_HASH_TABLE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _HevHashTable HevHashTable;
+
+typedef void (*HevHashTableFunc) (void *value, void *data);
+
+HevHashTable *hev_hash_table_new (unsigned int key_size,
+                                  unsigned int capacity);
+void hev_hash_table_destroy (HevHashTable *self);
+
+int hev_hash_table_insert (HevHashTable *self, const void *key, void *value);
+void *hev_hash_table_lookup (HevHashTable *self, const void *key);
+int hev_hash_table_remove (HevHashTable *self, const void *key);
+
+unsigned int hev_hash_table_size (HevHashTable *self);
+void hev_hash_table_foreach (HevHashTable *self, HevHashTableFunc func,
+                             void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HEV_HASH_TABLE_H__ */
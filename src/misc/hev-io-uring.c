@@ -0,0 +1,627 @@
+/*
+ ============================================================================
+ Name        : hev-io-uring.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : IO Uring
+ ============================================================================
+ */
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include (<linux/io_uring.h>)
+#define HEV_IO_URING_SUPPORTED 1
+#endif
+#endif
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <hev-memory-allocator.h>
+
+#include "hev-logger.h"
+
+#include "hev-io-uring.h"
+
+#ifdef HEV_IO_URING_SUPPORTED
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include "hev-list.h"
+#include "hev-mutex.h"
+#include "hev-compiler.h"
+
+/* an op the caller could not queue; retry on the readiness path */
+#define IO_URING_FALLBACK (-2)
+
+typedef struct _HevIoUringOp HevIoUringOp;
+
+struct _HevIoUringOp
+{
+    HevListNode node;
+    HevTask *task;
+    ssize_t res;
+    int done;
+    int canceled;
+};
+
+static int ring_fd = -1;
+static int event_fd = -1;
+
+static void *sq_ring;
+static void *cq_ring;
+static size_t sq_ring_size;
+static size_t cq_ring_size;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cq_cqes;
+
+static unsigned int sq_entries;
+static unsigned int *sq_khead;
+static unsigned int *sq_ktail;
+static unsigned int *sq_kmask;
+static unsigned int *sq_karray;
+static unsigned int *cq_khead;
+static unsigned int *cq_ktail;
+static unsigned int *cq_kmask;
+
+static unsigned int sq_tail;
+static unsigned int to_submit;
+
+static HevMutex mutex;
+static HevList ops_set;
+static HevTask *task_disp;
+static int uring_run;
+
+static int
+sys_io_uring_setup (unsigned int entries, struct io_uring_params *params)
+{
+    return syscall (__NR_io_uring_setup, entries, params);
+}
+
+static int
+sys_io_uring_enter (int fd, unsigned int submit, unsigned int complete,
+                    unsigned int flags)
+{
+    return syscall (__NR_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register (int fd, unsigned int opcode, void *arg, unsigned int nr)
+{
+    return syscall (__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+static struct io_uring_sqe *
+io_uring_get_sqe (void)
+{
+    unsigned int head;
+
+    head = __atomic_load_n (sq_khead, __ATOMIC_ACQUIRE);
+    if (sq_tail - head >= sq_entries)
+        return NULL;
+
+    return &sqes[sq_tail & *sq_kmask];
+}
+
+static void
+io_uring_put_sqe (void)
+{
+    sq_karray[sq_tail & *sq_kmask] = sq_tail & *sq_kmask;
+    sq_tail++;
+    __atomic_store_n (sq_ktail, sq_tail, __ATOMIC_RELEASE);
+    to_submit++;
+}
+
+/*
+ * The op completes even after the caller gives up, so an abandoned
+ * op is handed to the dispatcher for release and a cancel is queued
+ * to bound the wait.
+ */
+static void
+io_uring_op_cancel (HevIoUringOp *op)
+{
+    struct io_uring_sqe *sqe;
+    HevIoUringOp *cop;
+
+    cop = hev_malloc0 (sizeof (HevIoUringOp));
+    if (!cop)
+        return;
+
+    hev_mutex_lock (&mutex);
+    sqe = io_uring_get_sqe ();
+    if (!sqe) {
+        hev_mutex_unlock (&mutex);
+        hev_free (cop);
+        return;
+    }
+
+    memset (sqe, 0, sizeof (*sqe));
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t)op;
+    sqe->user_data = (uintptr_t)cop;
+    cop->canceled = 1;
+    op->canceled = 1;
+    hev_list_add_tail (&ops_set, &cop->node);
+    io_uring_put_sqe ();
+    hev_mutex_unlock (&mutex);
+
+    hev_task_wakeup (task_disp);
+}
+
+static ssize_t
+io_uring_op_wait (HevIoUringOp *op, HevTaskIOYielder yielder,
+                  void *yielder_data)
+{
+    int canceled = 0;
+    ssize_t res;
+
+    for (; !op->done;) {
+        int stop;
+
+        if (yielder) {
+            stop = yielder (HEV_TASK_WAITIO, yielder_data);
+        } else {
+            hev_task_yield (HEV_TASK_WAITIO);
+            stop = 0;
+        }
+
+        if (stop && !canceled) {
+            io_uring_op_cancel (op);
+            canceled = 1;
+        }
+    }
+
+    res = op->res;
+    hev_free (op);
+
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+
+    return res;
+}
+
+static ssize_t
+io_uring_op_submit (unsigned char opcode, int fd, const void *addr,
+                    unsigned int len, HevTaskIOYielder yielder,
+                    void *yielder_data)
+{
+    struct io_uring_sqe *sqe;
+    HevIoUringOp *op;
+
+    op = hev_malloc0 (sizeof (HevIoUringOp));
+    if (!op)
+        return IO_URING_FALLBACK;
+
+    op->task = hev_task_self ();
+
+    hev_mutex_lock (&mutex);
+    sqe = io_uring_get_sqe ();
+    if (!sqe) {
+        hev_mutex_unlock (&mutex);
+        hev_free (op);
+        return IO_URING_FALLBACK;
+    }
+
+    memset (sqe, 0, sizeof (*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)addr;
+    sqe->len = len;
+    sqe->user_data = (uintptr_t)op;
+    hev_list_add_tail (&ops_set, &op->node);
+    io_uring_put_sqe ();
+    hev_mutex_unlock (&mutex);
+
+    hev_task_wakeup (task_disp);
+
+    return io_uring_op_wait (op, yielder, yielder_data);
+}
+
+static unsigned int
+io_uring_reap (void)
+{
+    unsigned int head, tail, n = 0;
+
+    head = *cq_khead;
+    tail = __atomic_load_n (cq_ktail, __ATOMIC_ACQUIRE);
+
+    hev_mutex_lock (&mutex);
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe;
+        HevIoUringOp *op;
+
+        cqe = &cq_cqes[head & *cq_kmask];
+        op = (HevIoUringOp *)(uintptr_t)cqe->user_data;
+        hev_list_del (&ops_set, &op->node);
+        op->res = cqe->res;
+        op->done = 1;
+        if (op->task)
+            hev_task_wakeup (op->task);
+        else
+            hev_free (op);
+        n++;
+    }
+    hev_mutex_unlock (&mutex);
+
+    __atomic_store_n (cq_khead, head, __ATOMIC_RELEASE);
+
+    return n;
+}
+
+/*
+ * Queue a cancel for every op still in flight; cancel companions are
+ * marked so repeated drain passes do not cancel the cancels. Stops
+ * early when the SQ fills, the next pass picks up the rest.
+ */
+static void
+io_uring_cancel_pending (void)
+{
+    HevListNode *node;
+
+    hev_mutex_lock (&mutex);
+    node = hev_list_first (&ops_set);
+    for (; node; node = hev_list_node_next (node)) {
+        HevIoUringOp *op = container_of (node, HevIoUringOp, node);
+        struct io_uring_sqe *sqe;
+        HevIoUringOp *cop;
+
+        if (op->canceled)
+            continue;
+
+        cop = hev_malloc0 (sizeof (HevIoUringOp));
+        if (!cop)
+            break;
+
+        sqe = io_uring_get_sqe ();
+        if (!sqe) {
+            hev_free (cop);
+            break;
+        }
+
+        memset (sqe, 0, sizeof (*sqe));
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t)op;
+        sqe->user_data = (uintptr_t)cop;
+        cop->canceled = 1;
+        op->canceled = 1;
+        hev_list_add_tail (&ops_set, &cop->node);
+        io_uring_put_sqe ();
+    }
+    hev_mutex_unlock (&mutex);
+}
+
+static void
+io_uring_task_entry (void *data)
+{
+    LOG_D ("io uring task run");
+
+    for (;;) {
+        unsigned int n;
+        uint64_t val;
+
+        /*
+         * On stop, ops armed for fast poll would otherwise never
+         * complete and their tasks would sleep forever; keep running
+         * until every in-flight op has been canceled and reaped.
+         */
+        if (!uring_run)
+            io_uring_cancel_pending ();
+
+        hev_mutex_lock (&mutex);
+        n = to_submit;
+        to_submit = 0;
+        hev_mutex_unlock (&mutex);
+
+        if (n)
+            sys_io_uring_enter (ring_fd, n, 0, 0);
+
+        n += io_uring_reap ();
+        read (event_fd, &val, sizeof (val));
+
+        if (!uring_run) {
+            int pending;
+
+            hev_mutex_lock (&mutex);
+            pending = hev_list_first (&ops_set) != NULL;
+            hev_mutex_unlock (&mutex);
+            if (!pending)
+                break;
+            if (!n)
+                hev_task_sleep (10);
+            continue;
+        }
+
+        if (!n)
+            hev_task_yield (HEV_TASK_WAITIO);
+    }
+}
+
+void
+hev_io_uring_init (unsigned int entries, int smp)
+{
+    struct io_uring_params params = { 0 };
+    size_t sqes_size;
+
+    LOG_D ("io uring init");
+
+    ring_fd = sys_io_uring_setup (entries, &params);
+    if (ring_fd < 0) {
+        LOG_W ("io uring setup");
+        goto exit;
+    }
+
+    /* without fast poll a non-blocking fd just completes with EAGAIN */
+    if (!(params.features & IORING_FEAT_FAST_POLL)) {
+        LOG_W ("io uring fast poll");
+        goto exit_close_ring;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size > sq_ring_size)
+            sq_ring_size = cq_ring_size;
+        cq_ring_size = sq_ring_size;
+    }
+
+    sq_ring = mmap (NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        LOG_E ("io uring sq ring");
+        goto exit_close_ring;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap (NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            LOG_E ("io uring cq ring");
+            goto exit_unmap_sq;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+    sqes = mmap (NULL, sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOG_E ("io uring sqes");
+        goto exit_unmap_cq;
+    }
+
+    sq_entries = params.sq_entries;
+    sq_khead = sq_ring + params.sq_off.head;
+    sq_ktail = sq_ring + params.sq_off.tail;
+    sq_kmask = sq_ring + params.sq_off.ring_mask;
+    sq_karray = sq_ring + params.sq_off.array;
+    cq_khead = cq_ring + params.cq_off.head;
+    cq_ktail = cq_ring + params.cq_off.tail;
+    cq_kmask = cq_ring + params.cq_off.ring_mask;
+    sq_tail = *sq_ktail;
+
+    event_fd = eventfd (0, EFD_NONBLOCK);
+    if (event_fd < 0) {
+        LOG_E ("io uring eventfd");
+        goto exit_unmap_sqes;
+    }
+
+    if (sys_io_uring_register (ring_fd, IORING_REGISTER_EVENTFD, &event_fd,
+                               1) < 0) {
+        LOG_E ("io uring register eventfd");
+        goto exit_close_event;
+    }
+
+    if (hev_mutex_init (&mutex, smp) < 0) {
+        LOG_E ("io uring mutex");
+        goto exit_close_event;
+    }
+
+    task_disp = hev_task_new (-1);
+    if (!task_disp) {
+        LOG_E ("io uring task");
+        goto exit_close_event;
+    }
+    hev_task_set_priority (task_disp, HEV_TASK_PRIORITY_REALTIME);
+
+    if (hev_task_add_fd (task_disp, event_fd, POLLIN) < 0) {
+        LOG_E ("io uring add fd");
+        goto exit_free_task;
+    }
+
+    return;
+
+exit_free_task:
+    hev_task_unref (task_disp);
+    task_disp = NULL;
+exit_close_event:
+    close (event_fd);
+    event_fd = -1;
+exit_unmap_sqes:
+    munmap (sqes, sqes_size);
+exit_unmap_cq:
+    if (cq_ring != sq_ring)
+        munmap (cq_ring, cq_ring_size);
+exit_unmap_sq:
+    munmap (sq_ring, sq_ring_size);
+exit_close_ring:
+    close (ring_fd);
+    ring_fd = -1;
+exit:
+    /* not fatal: the readiness loops keep working without the ring */
+    return;
+}
+
+void
+hev_io_uring_fini (void)
+{
+    if (ring_fd < 0)
+        return;
+
+    LOG_D ("io uring fini");
+
+    hev_task_unref (task_disp);
+    task_disp = NULL;
+
+    munmap (sqes, sq_entries * sizeof (struct io_uring_sqe));
+    if (cq_ring != sq_ring)
+        munmap (cq_ring, cq_ring_size);
+    munmap (sq_ring, sq_ring_size);
+
+    close (event_fd);
+    event_fd = -1;
+    close (ring_fd);
+    ring_fd = -1;
+}
+
+void
+hev_io_uring_run (void)
+{
+    if (ring_fd < 0)
+        return;
+
+    uring_run = 1;
+    task_disp = hev_task_ref (task_disp);
+    hev_task_run (task_disp, io_uring_task_entry, NULL);
+}
+
+void
+hev_io_uring_stop (void)
+{
+    if (!uring_run)
+        return;
+
+    uring_run = 0;
+    hev_task_wakeup (task_disp);
+}
+
+ssize_t
+hev_io_uring_read (int fd, void *buf, size_t count, HevTaskIOYielder yielder,
+                   void *yielder_data)
+{
+    if (uring_run) {
+        ssize_t s;
+
+        s = io_uring_op_submit (IORING_OP_READ, fd, buf, count, yielder,
+                                yielder_data);
+        if (s != IO_URING_FALLBACK)
+            return s;
+    }
+
+    return hev_task_io_read (fd, buf, count, yielder, yielder_data);
+}
+
+ssize_t
+hev_io_uring_readv (int fd, const struct iovec *iov, int iovcnt,
+                    HevTaskIOYielder yielder, void *yielder_data)
+{
+    if (uring_run) {
+        ssize_t s;
+
+        s = io_uring_op_submit (IORING_OP_READV, fd, iov, iovcnt, yielder,
+                                yielder_data);
+        if (s != IO_URING_FALLBACK)
+            return s;
+    }
+
+    return hev_task_io_readv (fd, (struct iovec *)iov, iovcnt, yielder,
+                              yielder_data);
+}
+
+ssize_t
+hev_io_uring_write (int fd, const void *buf, size_t count,
+                    HevTaskIOYielder yielder, void *yielder_data)
+{
+    if (uring_run) {
+        ssize_t s;
+
+        s = io_uring_op_submit (IORING_OP_WRITE, fd, buf, count, yielder,
+                                yielder_data);
+        if (s != IO_URING_FALLBACK)
+            return s;
+    }
+
+    return hev_task_io_write (fd, (void *)buf, count, yielder, yielder_data);
+}
+
+ssize_t
+hev_io_uring_writev (int fd, const struct iovec *iov, int iovcnt,
+                     HevTaskIOYielder yielder, void *yielder_data)
+{
+    if (uring_run) {
+        ssize_t s;
+
+        s = io_uring_op_submit (IORING_OP_WRITEV, fd, iov, iovcnt, yielder,
+                                yielder_data);
+        if (s != IO_URING_FALLBACK)
+            return s;
+    }
+
+    return hev_task_io_writev (fd, (struct iovec *)iov, iovcnt, yielder,
+                               yielder_data);
+}
+
+#else /* !HEV_IO_URING_SUPPORTED */
+
+void
+hev_io_uring_init (unsigned int entries, int smp)
+{
+    LOG_W ("io uring unsupported");
+}
+
+void
+hev_io_uring_fini (void)
+{
+}
+
+void
+hev_io_uring_run (void)
+{
+}
+
+void
+hev_io_uring_stop (void)
+{
+}
+
+ssize_t
+hev_io_uring_read (int fd, void *buf, size_t count, HevTaskIOYielder yielder,
+                   void *yielder_data)
+{
+    return hev_task_io_read (fd, buf, count, yielder, yielder_data);
+}
+
+ssize_t
+hev_io_uring_readv (int fd, const struct iovec *iov, int iovcnt,
+                    HevTaskIOYielder yielder, void *yielder_data)
+{
+    return hev_task_io_readv (fd, (struct iovec *)iov, iovcnt, yielder,
+                              yielder_data);
+}
+
+ssize_t
+hev_io_uring_write (int fd, const void *buf, size_t count,
+                    HevTaskIOYielder yielder, void *yielder_data)
+{
+    return hev_task_io_write (fd, (void *)buf, count, yielder, yielder_data);
+}
+
+ssize_t
+hev_io_uring_writev (int fd, const struct iovec *iov, int iovcnt,
+                     HevTaskIOYielder yielder, void *yielder_data)
+{
+    return hev_task_io_writev (fd, (struct iovec *)iov, iovcnt, yielder,
+                               yielder_data);
+}
+
+#endif /* !HEV_IO_URING_SUPPORTED */
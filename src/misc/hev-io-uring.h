@@ -0,0 +1,41 @@
+/*
+ ============================================================================
+ Name        : hev-io-uring.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : IO Uring
+ ============================================================================
+ */
+
+#ifndef __HEV_IO_URING_H__
+#define __HEV_IO_URING_H__
+
+#include <sys/uio.h>
+
+#include <hev-task.h>
+#include <hev-task-io.h>
+
+/*
+ * Batched io_uring backend: callers queue SQEs and park until the
+ * dispatcher reaps their CQE, so one io_uring_enter covers every
+ * operation queued in the same scheduler pass. Falls back to the
+ * hev-task-io readiness loops when the ring is unavailable.
+ */
+
+/* best effort: falls back to the readiness loops on any failure */
+void hev_io_uring_init (unsigned int entries, int smp);
+void hev_io_uring_fini (void);
+
+void hev_io_uring_run (void);
+void hev_io_uring_stop (void);
+
+ssize_t hev_io_uring_read (int fd, void *buf, size_t count,
+                           HevTaskIOYielder yielder, void *yielder_data);
+ssize_t hev_io_uring_readv (int fd, const struct iovec *iov, int iovcnt,
+                            HevTaskIOYielder yielder, void *yielder_data);
+ssize_t hev_io_uring_write (int fd, const void *buf, size_t count,
+                            HevTaskIOYielder yielder, void *yielder_data);
+ssize_t hev_io_uring_writev (int fd, const struct iovec *iov, int iovcnt,
+                             HevTaskIOYielder yielder, void *yielder_data);
+
+#endif /* __HEV_IO_URING_H__ */
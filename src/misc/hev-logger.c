@@ -16,11 +16,37 @@
 #include <sys/uio.h>
 #include <sys/stat.h>
 
+#include <hev-task.h>
+
 #include "hev-logger.h"
 
+#define LOGGER_RING_SIZE (512) /* power of two */
+#define LOGGER_MSG_SIZE (240)
+
+typedef struct _HevLoggerRecord HevLoggerRecord;
+
+struct _HevLoggerRecord
+{
+    unsigned int seq;
+    HevLoggerLevel level;
+    time_t time;
+    char msg[LOGGER_MSG_SIZE];
+};
+
 static int fd = -1;
 static HevLoggerLevel req_level;
 
+/*
+ * Async mode: hot paths claim a slot in a bounded MPSC ring (Vyukov
+ * sequence scheme) and format in place; a drain task batches the
+ * write(2) calls. Overflow drops the record and counts it.
+ */
+static HevLoggerRecord ring[LOGGER_RING_SIZE];
+static unsigned int enqueue_pos;
+static unsigned int dequeue_pos;
+static unsigned int ring_drops;
+static int async_run;
+
 int
 hev_logger_init (HevLoggerLevel level, const char *path)
 {
@@ -54,54 +80,47 @@ hev_logger_enabled (HevLoggerLevel level)
     return 0;
 }
 
-void
-hev_logger_log (HevLoggerLevel level, const char *fmt, ...)
+static const char *
+hev_logger_level_tag (HevLoggerLevel level)
+{
+    switch (level) {
+    case HEV_LOGGER_DEBUG:
+        return "[D] ";
+    case HEV_LOGGER_INFO:
+        return "[I] ";
+    case HEV_LOGGER_WARN:
+        return "[W] ";
+    case HEV_LOGGER_ERROR:
+        return "[E] ";
+    case HEV_LOGGER_UNSET:
+        break;
+    }
+
+    return "[?] ";
+}
+
+static void
+hev_logger_write (HevLoggerLevel level, time_t now, const char *msg,
+                  unsigned int len)
 {
     struct iovec iov[4];
     const char *ts_fmt;
-    char msg[1024];
     struct tm *ti;
     char ts[32];
-    time_t now;
-    va_list ap;
-    int len;
 
-    if (fd < 0 || level < req_level)
-        return;
-
-    time (&now);
     ti = localtime (&now);
 
     ts_fmt = "[%04u-%02u-%02u %02u:%02u:%02u] ";
-    len = snprintf (ts, sizeof (ts), ts_fmt, 1900 + ti->tm_year, 1 + ti->tm_mon,
-                    ti->tm_mday, ti->tm_hour, ti->tm_min, ti->tm_sec);
-
     iov[0].iov_base = ts;
-    iov[0].iov_len = len;
+    iov[0].iov_len = snprintf (ts, sizeof (ts), ts_fmt, 1900 + ti->tm_year,
+                               1 + ti->tm_mon, ti->tm_mday, ti->tm_hour,
+                               ti->tm_min, ti->tm_sec);
 
-    switch (level) {
-    case HEV_LOGGER_DEBUG:
-        iov[1].iov_base = "[D] ";
-        break;
-    case HEV_LOGGER_INFO:
-        iov[1].iov_base = "[I] ";
-        break;
-    case HEV_LOGGER_WARN:
-        iov[1].iov_base = "[W] ";
-        break;
-    case HEV_LOGGER_ERROR:
-        iov[1].iov_base = "[E] ";
-        break;
-    case HEV_LOGGER_UNSET:
-        iov[1].iov_base = "[?] ";
-        break;
-    }
+    iov[1].iov_base = (void *)hev_logger_level_tag (level);
     iov[1].iov_len = 4;
 
-    va_start (ap, fmt);
-    iov[2].iov_base = msg;
-    iov[2].iov_len = vsnprintf (msg, 1024, fmt, ap);
-    va_end (ap);
+    iov[2].iov_base = (void *)msg;
+    iov[2].iov_len = len;
 
     iov[3].iov_base = "\n";
     iov[3].iov_len = 1;
@@ -110,3 +129,147 @@ hev_logger_log (HevLoggerLevel level, const char *fmt, ...)
         /* ignore return value */
     }
 }
+
+static void
+hev_logger_ring_push (HevLoggerLevel level, const char *fmt, va_list ap)
+{
+    HevLoggerRecord *rec;
+    unsigned int pos;
+
+    pos = __atomic_load_n (&enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        unsigned int seq;
+        int dif;
+
+        rec = &ring[pos & (LOGGER_RING_SIZE - 1)];
+        seq = __atomic_load_n (&rec->seq, __ATOMIC_ACQUIRE);
+        dif = (int)(seq - pos);
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n (&enqueue_pos, &pos, pos + 1, 1,
+                                             __ATOMIC_RELAXED,
+                                             __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            __atomic_fetch_add (&ring_drops, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n (&enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    rec->level = level;
+    time (&rec->time);
+    vsnprintf (rec->msg, LOGGER_MSG_SIZE, fmt, ap);
+    __atomic_store_n (&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int
+hev_logger_ring_drain (void)
+{
+    unsigned int n = 0;
+    unsigned int drops;
+
+    for (;;) {
+        HevLoggerRecord *rec;
+        unsigned int seq;
+
+        rec = &ring[dequeue_pos & (LOGGER_RING_SIZE - 1)];
+        seq = __atomic_load_n (&rec->seq, __ATOMIC_ACQUIRE);
+        if (seq != dequeue_pos + 1)
+            break;
+
+        hev_logger_write (rec->level, rec->time, rec->msg,
+                          strlen (rec->msg));
+        __atomic_store_n (&rec->seq, dequeue_pos + LOGGER_RING_SIZE,
+                          __ATOMIC_RELEASE);
+        dequeue_pos++;
+        n++;
+    }
+
+    drops = __atomic_exchange_n (&ring_drops, 0, __ATOMIC_RELAXED);
+    if (drops) {
+        char msg[64];
+        time_t now;
+
+        time (&now);
+        snprintf (msg, sizeof (msg), "logger dropped %u records", drops);
+        hev_logger_write (HEV_LOGGER_WARN, now, msg, strlen (msg));
+    }
+
+    return n;
+}
+
+static void
+hev_logger_task_entry (void *data)
+{
+    for (;;) {
+        unsigned int n;
+
+        n = hev_logger_ring_drain ();
+        if (!async_run && !n)
+            break;
+        if (!n)
+            hev_task_sleep (100);
+        else
+            hev_task_yield (HEV_TASK_YIELD);
+    }
+}
+
+void
+hev_logger_run (void)
+{
+    HevTask *task;
+    unsigned int i;
+
+    if (fd < 0 || async_run)
+        return;
+
+    task = hev_task_new (-1);
+    if (!task)
+        return;
+
+    for (i = 0; i < LOGGER_RING_SIZE; i++)
+        ring[i].seq = i;
+    enqueue_pos = 0;
+    dequeue_pos = 0;
+
+    async_run = 1;
+    hev_task_run (task, hev_logger_task_entry, NULL);
+}
+
+void
+hev_logger_stop (void)
+{
+    if (!async_run)
+        return;
+
+    /* the drain task flushes the tail and exits on its own */
+    async_run = 0;
+}
+
+void
+hev_logger_log (HevLoggerLevel level, const char *fmt, ...)
+{
+    char msg[1024];
+    time_t now;
+    va_list ap;
+    int len;
+
+    if (fd < 0 || level < req_level)
+        return;
+
+    if (async_run) {
+        va_start (ap, fmt);
+        hev_logger_ring_push (level, fmt, ap);
+        va_end (ap);
+        return;
+    }
+
+    time (&now);
+    va_start (ap, fmt);
+    len = vsnprintf (msg, 1024, fmt, ap);
+    va_end (ap);
+
+    hev_logger_write (level, now, msg, len);
+}
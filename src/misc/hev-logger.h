@@ -33,6 +33,9 @@ typedef enum
 int hev_logger_init (HevLoggerLevel level, const char *path);
 void hev_logger_fini (void);
 
+void hev_logger_run (void);
+void hev_logger_stop (void);
+
 int hev_logger_enabled (HevLoggerLevel level);
 void hev_logger_log (HevLoggerLevel level, const char *fmt, ...);
 
@@ -0,0 +1,47 @@
+/*
+ ============================================================================
+ Name        : hev-mutex.c
+ Authors     : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 everyone.
+ Description : Thread-aware Task Mutex
+ ============================================================================
+ */
+
+#include <hev-task.h>
+
+#include "hev-mutex.h"
+
+int
+hev_mutex_init (HevMutex *self, int smp)
+{
+    self->smp = smp;
+
+    if (smp)
+        return pthread_mutex_init (&self->pmutex, NULL);
+
+    hev_task_mutex_init (&self->tmutex);
+    return 0;
+}
+
+void
+hev_mutex_lock (HevMutex *self)
+{
+    if (!self->smp) {
+        hev_task_mutex_lock (&self->tmutex);
+        return;
+    }
+
+    while (pthread_mutex_trylock (&self->pmutex) != 0)
+        hev_task_yield (HEV_TASK_YIELD);
+}
+
+void
+hev_mutex_unlock (HevMutex *self)
+{
+    if (!self->smp) {
+        hev_task_mutex_unlock (&self->tmutex);
+        return;
+    }
+
+    pthread_mutex_unlock (&self->pmutex);
+}
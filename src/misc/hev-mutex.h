@@ -0,0 +1,44 @@
+/*
+ ============================================================================
+ Name        : hev-mutex.h
+ Authors     : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 everyone.
+ Description : Thread-aware Task Mutex
+ ============================================================================
+ */
+
+#ifndef __HEV_MUTEX_H__
+#define __HEV_MUTEX_H__
+
+#include <pthread.h>
+
+#include <hev-task-mutex.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * In single-threaded mode this is a plain HevTaskMutex. In SMP mode the
+ * lock is a process mutex acquired with a trylock-and-yield loop, so a
+ * task never blocks its worker thread while the holder is parked on
+ * another one.
+ */
+typedef struct _HevMutex HevMutex;
+
+struct _HevMutex
+{
+    HevTaskMutex tmutex;
+    pthread_mutex_t pmutex;
+    int smp;
+};
+
+int hev_mutex_init (HevMutex *self, int smp);
+void hev_mutex_lock (HevMutex *self);
+void hev_mutex_unlock (HevMutex *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HEV_MUTEX_H__ */
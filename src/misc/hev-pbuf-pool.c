@@ -0,0 +1,148 @@
+/*
+ ============================================================================
+ Name        : hev-pbuf-pool.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Pbuf Pool
+ ============================================================================
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <hev-memory-allocator.h>
+
+#include "hev-compiler.h"
+#include "hev-mutex.h"
+
+#include "hev-pbuf-pool.h"
+
+/* room for the layer offset pbuf_alloced_custom applies */
+#define HEV_PBUF_POOL_HEADROOM (128)
+
+typedef struct _HevPbufSlab HevPbufSlab;
+
+struct _HevPbufSlab
+{
+    struct pbuf_custom pc;
+    HevPbufSlab *next;
+    unsigned char payload[];
+};
+
+static void *base;
+static HevMutex mutex;
+static HevPbufSlab *free_list;
+static unsigned int slab_size;
+static unsigned int slab_total;
+static unsigned int slab_used;
+static unsigned int slab_misses;
+
+/* pool pbufs are freed from worker threads, outside the lwip mutex */
+static void
+hev_pbuf_pool_free_handler (struct pbuf *p)
+{
+    HevPbufSlab *slab = (HevPbufSlab *)p;
+
+    hev_mutex_lock (&mutex);
+    slab->next = free_list;
+    free_list = slab;
+    slab_used--;
+    hev_mutex_unlock (&mutex);
+}
+
+int
+hev_pbuf_pool_init (unsigned int size, unsigned int count, int smp)
+{
+    unsigned int step;
+    unsigned int i;
+
+    if (hev_mutex_init (&mutex, smp) < 0)
+        return -1;
+
+    slab_size = ALIGN_UP (size + HEV_PBUF_POOL_HEADROOM, 64);
+    step = ALIGN_UP (sizeof (HevPbufSlab) + slab_size, 64);
+
+    base = hev_malloc (step * count);
+    if (!base)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        HevPbufSlab *slab = base + step * i;
+
+        slab->next = free_list;
+        free_list = slab;
+    }
+    slab_total = count;
+
+    return 0;
+}
+
+void
+hev_pbuf_pool_fini (void)
+{
+    free_list = NULL;
+    slab_total = 0;
+    slab_used = 0;
+
+    hev_free (base);
+    base = NULL;
+}
+
+struct pbuf *
+hev_pbuf_pool_alloc (pbuf_layer layer, unsigned int len)
+{
+    HevPbufSlab *slab;
+    struct pbuf *buf;
+
+    if (len + HEV_PBUF_POOL_HEADROOM > slab_size) {
+        slab_misses++;
+        return pbuf_alloc (layer, len, PBUF_RAM);
+    }
+
+    hev_mutex_lock (&mutex);
+    slab = free_list;
+    if (slab) {
+        free_list = slab->next;
+        slab_used++;
+    } else {
+        slab_misses++;
+    }
+    hev_mutex_unlock (&mutex);
+
+    if (!slab)
+        return pbuf_alloc (layer, len, PBUF_RAM);
+
+    memset (&slab->pc, 0, sizeof (slab->pc));
+    slab->pc.custom_free_function = hev_pbuf_pool_free_handler;
+
+    buf = pbuf_alloced_custom (layer, len, PBUF_RAM, &slab->pc, slab->payload,
+                               slab_size);
+    if (!buf) {
+        hev_mutex_lock (&mutex);
+        slab->next = free_list;
+        free_list = slab;
+        slab_used--;
+        hev_mutex_unlock (&mutex);
+        return NULL;
+    }
+
+    return buf;
+}
+
+unsigned int
+hev_pbuf_pool_get_total (void)
+{
+    return slab_total;
+}
+
+unsigned int
+hev_pbuf_pool_get_used (void)
+{
+    return slab_used;
+}
+
+unsigned int
+hev_pbuf_pool_get_misses (void)
+{
+    return slab_misses;
+}
@@ -0,0 +1,32 @@
+/*
+ ============================================================================
+ Name        : hev-pbuf-pool.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Pbuf Pool
+ ============================================================================
+ */
+
+#ifndef __HEV_PBUF_POOL_H__
+#define __HEV_PBUF_POOL_H__
+
+#include <lwip/pbuf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int hev_pbuf_pool_init (unsigned int size, unsigned int count, int smp);
+void hev_pbuf_pool_fini (void);
+
+struct pbuf *hev_pbuf_pool_alloc (pbuf_layer layer, unsigned int len);
+
+unsigned int hev_pbuf_pool_get_total (void);
+unsigned int hev_pbuf_pool_get_used (void);
+unsigned int hev_pbuf_pool_get_misses (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HEV_PBUF_POOL_H__ */
@@ -0,0 +1,88 @@
+/*
+ ============================================================================
+ Name        : hev-ring.c
+ Authors     : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 everyone.
+ Description : Lock-free SPSC Ring
+ ============================================================================
+ */
+
+#include <hev-memory-allocator.h>
+
+#include "hev-compiler.h"
+
+#include "hev-ring.h"
+
+struct _HevRing
+{
+    unsigned int mask;
+    unsigned int head;
+    unsigned int tail;
+    void *slots[];
+};
+
+HevRing *
+hev_ring_new (unsigned int capacity)
+{
+    HevRing *self;
+    unsigned int cap;
+
+    for (cap = 16; cap < capacity;)
+        cap *= 2;
+
+    self = hev_malloc0 (sizeof (HevRing) + sizeof (void *) * cap);
+    if (!self)
+        return NULL;
+
+    self->mask = cap - 1;
+
+    return self;
+}
+
+void
+hev_ring_destroy (HevRing *self)
+{
+    hev_free (self);
+}
+
+/*
+ * The index updates publish the slot contents across threads, so they
+ * need release stores paired with acquire loads; a compiler barrier is
+ * only enough on strongly ordered CPUs, not on ARM.
+ */
+int
+hev_ring_push (HevRing *self, void *data)
+{
+    unsigned int head = __atomic_load_n (&self->head, __ATOMIC_ACQUIRE);
+    unsigned int tail = self->tail;
+
+    if (tail - head > self->mask)
+        return -1;
+
+    WRITE_ONCE (self->slots[tail & self->mask], data);
+    __atomic_store_n (&self->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void *
+hev_ring_pop (HevRing *self)
+{
+    unsigned int tail = __atomic_load_n (&self->tail, __ATOMIC_ACQUIRE);
+    unsigned int head = self->head;
+    void *data;
+
+    if (head == tail)
+        return NULL;
+
+    data = READ_ONCE (self->slots[head & self->mask]);
+    __atomic_store_n (&self->head, head + 1, __ATOMIC_RELEASE);
+
+    return data;
+}
+
+unsigned int
+hev_ring_size (HevRing *self)
+{
+    return READ_ONCE (self->tail) - READ_ONCE (self->head);
+}
@@ -0,0 +1,31 @@
+/*
+ ============================================================================
+ Name        : hev-ring.h
+ Authors     : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 everyone.
+ Description : Lock-free SPSC Ring
+ ============================================================================
+ */
+
+#ifndef __HEV_RING_H__
+#define __HEV_RING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _HevRing HevRing;
+
+HevRing *hev_ring_new (unsigned int capacity);
+void hev_ring_destroy (HevRing *self);
+
+int hev_ring_push (HevRing *self, void *data);
+void *hev_ring_pop (HevRing *self);
+
+unsigned int hev_ring_size (HevRing *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HEV_RING_H__ */
@@ -0,0 +1,120 @@
+/*
+ ============================================================================
+ Name        : hev-trie.c
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Binary Trie
+ ============================================================================
+ */
+
+#include <hev-memory-allocator.h>
+
+#include "hev-trie.h"
+
+typedef struct _HevTrieNode HevTrieNode;
+
+struct _HevTrieNode
+{
+    HevTrieNode *child[2];
+    uint8_t leaf;
+};
+
+struct _HevTrie
+{
+    HevTrieNode *pool;
+    unsigned int pool_size;
+    unsigned int pool_used;
+    HevTrieNode *root;
+};
+
+static HevTrieNode *
+trie_node_alloc (HevTrie *self)
+{
+    if (self->pool_used >= self->pool_size)
+        return NULL;
+
+    return &self->pool[self->pool_used++];
+}
+
+HevTrie *
+hev_trie_new (unsigned int prefixes)
+{
+    HevTrie *self;
+
+    self = hev_malloc0 (sizeof (HevTrie));
+    if (!self)
+        return NULL;
+
+    /* worst case one node per prefix bit, plus the root */
+    self->pool_size = prefixes * 128 + 1;
+    self->pool = hev_malloc0 (sizeof (HevTrieNode) * self->pool_size);
+    if (!self->pool) {
+        hev_free (self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+hev_trie_destroy (HevTrie *self)
+{
+    if (!self)
+        return;
+
+    hev_free (self->pool);
+    hev_free (self);
+}
+
+int
+hev_trie_add (HevTrie *self, const uint8_t *addr, unsigned int plen)
+{
+    HevTrieNode *node;
+    unsigned int i;
+
+    if (!self->root) {
+        self->root = trie_node_alloc (self);
+        if (!self->root)
+            return -1;
+    }
+
+    node = self->root;
+    for (i = 0; i < plen; i++) {
+        unsigned int bit = (addr[i >> 3] >> (7 - (i & 7))) & 1;
+
+        if (node->leaf)
+            return 0; /* covered by a shorter prefix */
+
+        if (!node->child[bit]) {
+            node->child[bit] = trie_node_alloc (self);
+            if (!node->child[bit])
+                return -1;
+        }
+        node = node->child[bit];
+    }
+
+    node->leaf = 1;
+
+    return 0;
+}
+
+int
+hev_trie_match (HevTrie *self, const uint8_t *addr, unsigned int bits)
+{
+    HevTrieNode *node = self->root;
+    unsigned int i;
+
+    for (i = 0; node; i++) {
+        unsigned int bit;
+
+        if (node->leaf)
+            return 1;
+        if (i >= bits)
+            break;
+
+        bit = (addr[i >> 3] >> (7 - (i & 7))) & 1;
+        node = node->child[bit];
+    }
+
+    return 0;
+}
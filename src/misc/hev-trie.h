@@ -0,0 +1,28 @@
+/*
+ ============================================================================
+ Name        : hev-trie.h
+ Author      : Heiher <r@hev.cc>
+ Copyright   : Copyright (c) 2021 hev
+ Description : Binary Trie
+ ============================================================================
+ */
+
+#ifndef __HEV_TRIE_H__
+#define __HEV_TRIE_H__
+
+#include <stdint.h>
+
+typedef struct _HevTrie HevTrie;
+
+/*
+ * Longest-prefix matcher over big-endian bit strings, backed by a
+ * node pool preallocated for the given number of prefixes; adds never
+ * allocate afterwards and matches are bit probes only.
+ */
+HevTrie *hev_trie_new (unsigned int prefixes);
+void hev_trie_destroy (HevTrie *self);
+
+int hev_trie_add (HevTrie *self, const uint8_t *addr, unsigned int plen);
+int hev_trie_match (HevTrie *self, const uint8_t *addr, unsigned int bits);
+
+#endif /* __HEV_TRIE_H__ */